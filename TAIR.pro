@@ -5,17 +5,46 @@ CONFIG += c++17
 
 SOURCES += \
     createrchart.cpp \
+    devicemanager.cpp \
     main.cpp \
+    replayclient.cpp \
+    scpiframer.cpp \
+    scpiparser.cpp \
+    sessioncapture.cpp \
     socket.cpp \
+    socketmetrics.cpp \
+    sweepexporter.cpp \
+    sweepfile.cpp \
+    sweeprecorder.cpp \
+    sweepring.cpp \
+    tracedata.cpp \
+    tracedecimator.cpp \
+    tracemath.cpp \
     vnacomand.cpp \
+    vnacontroller.cpp \
     widget.cpp\
 
 
 HEADERS += \
     createrchart.h \
+    devicemanager.h \
+    replayclient.h \
+    scpiframer.h \
+    scpiparser.h \
+    sessioncapture.h \
     socket.h \
+    socketmetrics.h \
+    sweepexporter.h \
+    sweepfile.h \
+    sweeprecorder.h \
+    sweepframe.h \
+    sweepring.h \
+    tracedata.h \
+    tracedecimator.h \
+    tracemath.h \
     vnaclient.h \
     vnacomand.h \
+    vnacontroller.h \
     widget.h
 
 FORMS += \
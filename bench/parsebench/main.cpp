@@ -0,0 +1,89 @@
+#include "scpiparser.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <cstdio>
+
+// Прежняя реализация из vnacomand.cpp: QString -> split -> toDouble -> каждое второе значение
+static QVector<qreal> legacyParseFdat(const QByteArray& raw)
+{
+    const QString data = QString::fromUtf8(raw);
+    QVector<qreal> all;
+    QStringList parts = data.trimmed().split(',', Qt::SkipEmptyParts);
+    all.reserve(parts.size());
+    for (const QString& p : parts) {
+        bool ok = false;
+        double v = p.toDouble(&ok);
+        if (ok) all.append((qreal)v);
+    }
+    QVector<qreal> out;
+    out.reserve((all.size()+1)/2);
+    for (int i = 0; i < all.size(); i += 2)
+        out.append(all[i]);
+    return out;
+}
+
+static QByteArray makeFdatReply(int points)
+{
+    QByteArray reply;
+    reply.reserve(points * 36);
+    for (int i = 0; i < points; ++i) {
+        if (i) reply.append(',');
+        reply.append(QByteArray::number(-20.0 + 10.0 * ((i * 7919) % 1000) / 1000.0, 'E', 9));
+        reply.append(',');
+        reply.append(QByteArray::number(0.0, 'E', 9));
+    }
+    reply.append('\n');
+    return reply;
+}
+
+template <typename F>
+static double medianNs(int iterations, F&& body)
+{
+    QVector<qint64> samples;
+    samples.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        body();
+        samples.append(timer.nsecsElapsed());
+    }
+    std::sort(samples.begin(), samples.end());
+    return double(samples[samples.size() / 2]);
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "points,bytes,legacy_us,fast_us,speedup\n";
+    const int pointCounts[] = { 201, 1601, 16001, 100001 };
+    for (int points : pointCounts) {
+        const QByteArray reply = makeFdatReply(points);
+        const int iterations = points > 20000 ? 20 : 200;
+        QVector<double> buffer(points);
+        volatile double sink = 0.0;
+
+        const double legacyNs = medianNs(iterations, [&]() {
+            QVector<qreal> v = legacyParseFdat(reply);
+            sink = sink + v.last();
+        });
+        const double fastNs = medianNs(iterations, [&]() {
+            const qsizetype n = parseScpiReals(reply.constData(), reply.constData() + reply.size(),
+                                               buffer.data(), buffer.size(), 2, 0);
+            sink = sink + buffer[n - 1];
+        });
+        if (parseScpiReals(reply.constData(), reply.constData() + reply.size(),
+                           buffer.data(), buffer.size(), 2, 0) != legacyParseFdat(reply).size()) {
+            fprintf(stderr, "value count mismatch at %d points\n", points);
+            return 1;
+        }
+        out << points << ',' << reply.size() << ','
+            << legacyNs / 1000.0 << ',' << fastNs / 1000.0 << ','
+            << (fastNs > 0 ? legacyNs / fastNs : 0.0) << '\n';
+    }
+    return 0;
+}
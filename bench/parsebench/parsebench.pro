@@ -0,0 +1,14 @@
+QT = core
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TARGET = parsebench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../scpiparser.cpp
+
+HEADERS += \
+    ../../scpiparser.h
@@ -0,0 +1,362 @@
+#include "socket.h"
+#include "createrchart.h"
+#include "vnasimulator.h"
+#include <QApplication>
+#include <QChartView>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Счётчик выделений памяти по потокам: свой у потока сокета и у GUI,
+// симулятор работает в третьем потоке и в замеры не попадает.
+static thread_local quint64 t_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++t_allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++t_allocations;
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+static qint64 threadCpuUs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return -1;
+    const quint64 k = (quint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    const quint64 u = (quint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return qint64((k + u) / 10);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return -1;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+struct ThreadSample
+{
+    qint64 cpuUs = 0;
+    quint64 allocations = 0;
+};
+
+static ThreadSample sampleCurrentThread()
+{
+    ThreadSample s;
+    s.cpuUs = threadCpuUs();
+    s.allocations = t_allocations;
+    return s;
+}
+
+static ThreadSample sampleThreadOf(QObject* object)
+{
+    ThreadSample s;
+    QMetaObject::invokeMethod(object, [&s]() { s = sampleCurrentThread(); }, Qt::BlockingQueuedConnection);
+    return s;
+}
+
+static double percentile(QVector<double> values, double p)
+{
+    if (values.isEmpty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const qsizetype index = qBound<qsizetype>(0, qsizetype(p * (values.size() - 1) + 0.5), values.size() - 1);
+    return values[index];
+}
+
+static QJsonObject distribution(const QVector<double>& values)
+{
+    QJsonObject o;
+    o.insert("p50", percentile(values, 0.50));
+    o.insert("p99", percentile(values, 0.99));
+    o.insert("max", percentile(values, 1.0));
+    return o;
+}
+
+struct BenchConfig
+{
+    int points = 201;
+    int traces = 1;
+    TraceDataFormat format = TraceDataFormat::Ascii;
+    QString formatName;
+    int sweeps = 30;
+    int warmup = 3;
+    int timeoutMs = 120000;
+};
+
+class SimulatorHost
+{
+public:
+    explicit SimulatorHost(const SimulatorOptions& options)
+    {
+        _simulator = new VnaSimulator(options);
+        _simulator->moveToThread(&_thread);
+        _thread.start();
+        QMetaObject::invokeMethod(_simulator, [this]() { _listening = _simulator->listen(); },
+                                  Qt::BlockingQueuedConnection);
+    }
+    ~SimulatorHost()
+    {
+        QMetaObject::invokeMethod(_simulator, [this]() { delete _simulator; }, Qt::BlockingQueuedConnection);
+        _thread.quit();
+        _thread.wait();
+    }
+
+    bool listening() const { return _listening; }
+    quint16 port() const { return _simulator->serverPort(); }
+    quint64 bytesSent()
+    {
+        quint64 bytes = 0;
+        QMetaObject::invokeMethod(_simulator, [this, &bytes]() { bytes = _simulator->bytesSent(); },
+                                  Qt::BlockingQueuedConnection);
+        return bytes;
+    }
+
+private:
+    QThread _thread;
+    VnaSimulator* _simulator = nullptr;
+    bool _listening = false;
+};
+
+static QJsonObject runConfig(const BenchConfig& config, SimulatorHost& simulator)
+{
+    QJsonObject result;
+    result.insert("points", config.points);
+    result.insert("traces", config.traces);
+    result.insert("format", config.formatName);
+
+    CreaterChart chart;
+    chart.initializeChart();
+    chart.setupAxes();
+    QVector<int> traceNumbers;
+    for (int t = 1; t <= config.traces; ++t) {
+        traceNumbers.append(t);
+        chart.addTrace(t, QString("Tr%1").arg(t), QColor::fromHsv((t * 47) % 360, 200, 220));
+    }
+    QChartView view(chart.getChart());
+    view.resize(1000, 640);
+    QImage canvas(view.size(), QImage::Format_ARGB32_Premultiplied);
+
+    Socket* socket = new Socket();
+    socket->setTimeouts(config.timeoutMs, config.timeoutMs, 0);
+    socket->setDataTransferMode(config.format, true);
+    socket->setGraphSettings(config.traces, traceNumbers);
+    socket->startThread();
+
+    QVector<double> latencyMs;
+    QVector<double> updateUs;
+    QVector<double> renderUs;
+    ThreadSample socketStart, socketEnd, guiStart, guiEnd;
+    quint64 bytesStart = 0;
+    quint64 bytesEnd = 0;
+    int received = 0;
+    QString failure;
+    QElapsedTimer wall;
+    qint64 wallNs = 0;
+    QEventLoop loop;
+
+    QObject::connect(socket, &VNAclient::error, &chart, [&](int code, const QString& message) {
+        failure = QString("%1: %2").arg(code).arg(message);
+        loop.quit();
+    });
+    QObject::connect(socket, &VNAclient::sweepReady, &chart, [&]() {
+        const SweepFramePtr frame = socket->takeSweep();
+        if (!frame) return;
+        ++received;
+        if (received == config.warmup) {
+            socketStart = sampleThreadOf(socket);
+            guiStart = sampleCurrentThread();
+            bytesStart = simulator.bytesSent();
+            wall.start();
+            return;
+        }
+        QElapsedTimer step;
+        step.start();
+        chart.updateSweep(*frame);
+        const qint64 updatedNs = step.nsecsElapsed();
+        QPainter painter(&canvas);
+        view.render(&painter);
+        painter.end();
+        const qint64 renderedNs = step.nsecsElapsed();
+        if (received <= config.warmup) return;
+
+        latencyMs.append(double(QDateTime::currentMSecsSinceEpoch() - frame->startedMs));
+        updateUs.append(updatedNs / 1000.0);
+        renderUs.append((renderedNs - updatedNs) / 1000.0);
+        if (received == config.warmup + config.sweeps) {
+            wallNs = wall.nsecsElapsed();
+            socketEnd = sampleThreadOf(socket);
+            guiEnd = sampleCurrentThread();
+            bytesEnd = simulator.bytesSent();
+            loop.quit();
+        }
+    });
+
+    QTimer guard;
+    guard.setSingleShot(true);
+    QObject::connect(&guard, &QTimer::timeout, &loop, [&]() {
+        failure = "timeout";
+        loop.quit();
+    });
+    guard.start(config.timeoutMs);
+
+    socket->startScan("127.0.0.1", simulator.port(), 100, 4800000, config.points, 1000, -10.0, 1000);
+    loop.exec();
+    socket->stopScan();
+    socket->stopThread();
+    delete socket;
+
+    if (!failure.isEmpty()) {
+        result.insert("error", failure);
+        result.insert("sweeps", qMax(0, received - config.warmup));
+        return result;
+    }
+
+    const int sweeps = config.sweeps;
+    const double wallS = wallNs / 1e9;
+    result.insert("sweeps", sweeps);
+    result.insert("wall_s", wallS);
+    result.insert("sweeps_per_s", wallS > 0 ? sweeps / wallS : 0.0);
+    result.insert("bytes_per_s", wallS > 0 ? double(bytesEnd - bytesStart) / wallS : 0.0);
+    result.insert("bytes_per_sweep", double(bytesEnd - bytesStart) / sweeps);
+    result.insert("sweep_to_screen_ms", distribution(latencyMs));
+    result.insert("chart_update_us", distribution(updateUs));
+    result.insert("render_us", distribution(renderUs));
+
+    QJsonObject cpu;
+    if (socketStart.cpuUs >= 0 && socketEnd.cpuUs >= 0) {
+        cpu.insert("socket_thread", double(socketEnd.cpuUs - socketStart.cpuUs) / sweeps);
+        cpu.insert("gui_thread", double(guiEnd.cpuUs - guiStart.cpuUs) / sweeps);
+    }
+    result.insert("cpu_us_per_sweep", cpu);
+
+    QJsonObject allocations;
+    allocations.insert("socket_thread", double(socketEnd.allocations - socketStart.allocations) / sweeps);
+    allocations.insert("gui_thread", double(guiEnd.allocations - guiStart.allocations) / sweeps);
+    result.insert("allocations_per_sweep", allocations);
+    return result;
+}
+
+static bool quietLog = true;
+
+static void benchMessageHandler(QtMsgType type, const QMessageLogContext&, const QString& message)
+{
+    if (quietLog && (type == QtDebugMsg || type == QtInfoMsg)) return;
+    std::fprintf(stderr, "%s\n", qPrintable(message));
+}
+
+static QVector<int> intList(const QString& value)
+{
+    QVector<int> out;
+    for (const QString& part : value.split(',', Qt::SkipEmptyParts))
+        out.append(part.trimmed().toInt());
+    return out;
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pipelinebench");
+    qRegisterMetaType<SweepFramePtr>("SweepFramePtr");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Сквозной замер конвейера: Socket -> разбор -> CreaterChart -> отрисовка");
+    parser.addHelpOption();
+    const QCommandLineOption pointsOption("points", "Comma-separated point counts.", "list", "201,1601,16001,100001");
+    const QCommandLineOption tracesOption("traces", "Comma-separated trace counts.", "list", "1,4,16");
+    const QCommandLineOption formatsOption("formats", "Comma-separated transfer formats: ascii,real32,real64.", "list", "ascii,real32,real64");
+    const QCommandLineOption sweepsOption("sweeps", "Measured sweeps per configuration.", "n", "30");
+    const QCommandLineOption warmupOption("warmup", "Warm-up sweeps per configuration.", "n", "3");
+    const QCommandLineOption sweepTimeOption("sweep-time", "Simulated sweep time, ms.", "ms", "0");
+    const QCommandLineOption pointTimeOption("point-time-us", "Simulated time per point, us.", "us", "0");
+    const QCommandLineOption latencyOption("latency", "Simulated reply latency, ms.", "ms", "0");
+    const QCommandLineOption outputOption("output", "Write JSON to file instead of stdout.", "file");
+    const QCommandLineOption verboseOption("verbose", "Keep debug output.");
+    parser.addOptions({pointsOption, tracesOption, formatsOption, sweepsOption, warmupOption,
+                       sweepTimeOption, pointTimeOption, latencyOption, outputOption, verboseOption});
+    parser.process(app);
+
+    quietLog = !parser.isSet(verboseOption);
+    qInstallMessageHandler(benchMessageHandler);
+
+    SimulatorOptions simOptions;
+    simOptions.port = 0;
+    simOptions.sweepTimeMs = parser.value(sweepTimeOption).toInt();
+    simOptions.pointTimeUs = parser.value(pointTimeOption).toInt();
+    simOptions.latencyMs = parser.value(latencyOption).toInt();
+    SimulatorHost simulator(simOptions);
+    if (!simulator.listening()) {
+        std::fprintf(stderr, "pipelinebench: simulator failed to listen\n");
+        return 1;
+    }
+
+    QJsonArray results;
+    for (const QString& formatName : parser.value(formatsOption).split(',', Qt::SkipEmptyParts)) {
+        const QString name = formatName.trimmed().toLower();
+        TraceDataFormat format = TraceDataFormat::Ascii;
+        if (name == "real32") format = TraceDataFormat::Real32;
+        else if (name == "real64" || name == "real") format = TraceDataFormat::Real64;
+        for (int traces : intList(parser.value(tracesOption))) {
+            for (int points : intList(parser.value(pointsOption))) {
+                BenchConfig config;
+                config.points = points;
+                config.traces = qBound(1, traces, 16);
+                config.format = format;
+                config.formatName = name;
+                config.sweeps = qMax(1, parser.value(sweepsOption).toInt());
+                config.warmup = qMax(1, parser.value(warmupOption).toInt());
+                std::fprintf(stderr, "pipelinebench: %s points=%d traces=%d\n",
+                             qPrintable(name), config.points, config.traces);
+                results.append(runConfig(config, simulator));
+            }
+        }
+    }
+
+    QJsonObject report;
+    report.insert("tool", "pipelinebench");
+    report.insert("qt", QString::fromLatin1(qVersion()));
+    report.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    report.insert("results", results);
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            std::fprintf(stderr, "pipelinebench: cannot write %s\n", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+        file.write(json);
+    } else {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+QT = core gui widgets charts network
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TARGET = pipelinebench
+
+INCLUDEPATH += ../.. ../../vnasim
+
+SOURCES += \
+    main.cpp \
+    ../../createrchart.cpp \
+    ../../scpiframer.cpp \
+    ../../scpiparser.cpp \
+    ../../sessioncapture.cpp \
+    ../../socket.cpp \
+    ../../socketmetrics.cpp \
+    ../../sweepfile.cpp \
+    ../../sweeprecorder.cpp \
+    ../../sweepring.cpp \
+    ../../tracedata.cpp \
+    ../../tracedecimator.cpp \
+    ../../vnacomand.cpp \
+    ../../vnasim/vnasimulator.cpp
+
+HEADERS += \
+    ../../createrchart.h \
+    ../../scpiframer.h \
+    ../../scpiparser.h \
+    ../../sessioncapture.h \
+    ../../socket.h \
+    ../../socketmetrics.h \
+    ../../sweepfile.h \
+    ../../sweeprecorder.h \
+    ../../sweepframe.h \
+    ../../sweepring.h \
+    ../../tracedata.h \
+    ../../tracedecimator.h \
+    ../../vnaclient.h \
+    ../../vnacomand.h \
+    ../../vnasim/vnasimulator.h
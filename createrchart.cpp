@@ -2,14 +2,39 @@
 #include <QtCharts/QChart>
 #include <QtCharts/QValueAxis>
 #include <QtCharts/QLineSeries>
+#include "tracedecimator.h"
 #include <QDebug>
+#include <algorithm>
 #include <limits>
 
+#define DEFAULT_PLOT_WIDTH_PX 1000
+
+static void computeBounds(ChartTraceData& data)
+{
+    const qsizetype size = data.x.size();
+    const qreal* x = data.x.constData();
+    const qreal* y = data.y.constData();
+    TraceBounds& bounds = data.bounds;
+    bounds.valid = size > 0;
+    if (!bounds.valid) return;
+    bounds.xMin = bounds.xMax = x[0];
+    bounds.yMin = bounds.yMax = y[0];
+    for (qsizetype i = 1; i < size; ++i)
+    {
+        bounds.xMin = qMin(bounds.xMin, x[i]);
+        bounds.xMax = qMax(bounds.xMax, x[i]);
+        bounds.yMin = qMin(bounds.yMin, y[i]);
+        bounds.yMax = qMax(bounds.yMax, y[i]);
+    }
+}
+
 CreaterChart::CreaterChart(QObject* parent)
     : QObject(parent)
     , _chart(nullptr)
     , _axisX(nullptr)
     , _axisY(nullptr)
+    , _plotWidth(0)
+    , _batchUpdate(false)
 {
     initializeChart();
 }
@@ -31,6 +56,7 @@ void CreaterChart::initializeChart()
     _chart->setAnimationOptions(QChart::NoAnimation);
     _chart->legend()->setVisible(true);
     _chart->setTheme(QChart::ChartThemeDark);
+    connect(_chart, &QChart::plotAreaChanged, this, &CreaterChart::onPlotAreaChanged);
 }
 
 void CreaterChart::setupAxes(const QString& xTitle, const QString& yTitle)
@@ -63,6 +89,7 @@ void CreaterChart::setupAxes(const QString& xTitle, const QString& yTitle)
     {
         _chart->addAxis(_axisX, Qt::AlignBottom);
         _chart->addAxis(_axisY, Qt::AlignLeft);
+        connect(_axisX, &QValueAxis::rangeChanged, this, &CreaterChart::onVisibleRangeChanged);
     }
 }
 
@@ -92,6 +119,7 @@ void CreaterChart::removeTrace(int traceNum)
     if (_seriesMap.contains(traceNum))
     {
         QLineSeries* series = _seriesMap.take(traceNum);
+        _traceDataMap.remove(traceNum);
         _chart->removeSeries(series);
         delete series;
     }
@@ -105,35 +133,199 @@ void CreaterChart::clearAllTraces()
         delete it.value();
     }
     _seriesMap.clear();
+    _traceDataMap.clear();
 }
 
 void CreaterChart::updateTraceData(int traceNum, const QVector<qreal>& xData, const QVector<qreal>& yData)
+{
+    if (storeTraceData(traceNum, xData, yData))
+    {
+        decimateTrace(traceNum);
+        _chart->update();
+    }
+}
+
+void CreaterChart::updateSweep(const SweepFrame& frame, int traceKeyOffset)
+{
+    bool changed = false;
+    for (auto it = frame.traces.constBegin(); it != frame.traces.constEnd(); ++it)
+    {
+        const int key = traceKeyOffset + it.key();
+        // трасса не перечитывалась в этом свипе — на графике уже эти данные
+        if (!frame.refreshedTraces.isEmpty() && !frame.refreshedTraces.contains(it.key())
+            && _traceDataMap.contains(key))
+        {
+            continue;
+        }
+        changed |= storeTraceData(key, frame.frequencyKHz, it.value().real());
+    }
+
+    if (changed)
+    {
+        _batchUpdate = true;
+        autoScaleAxes();
+        _batchUpdate = false;
+        decimateAll();
+        _chart->update();
+    }
+}
+
+void CreaterChart::updateSweepSegment(const SweepFrame& segment, int firstPoint, int totalPoints, int traceKeyOffset)
+{
+    QList<int> changed;
+    for (auto it = segment.traces.constBegin(); it != segment.traces.constEnd(); ++it)
+    {
+        const int key = traceKeyOffset + it.key();
+        if (!_seriesMap.contains(key))
+        {
+            continue;
+        }
+        const QVector<qreal>& y = it.value().real();
+        const qsizetype points = qMin(segment.frequencyKHz.size(), y.size());
+        if (points == 0)
+        {
+            continue;
+        }
+
+        ChartTraceData& data = _traceDataMap[key];
+        if (data.x.size() != totalPoints)
+        {
+            // первый свип с этим числом точек: буфер растёт сегмент за сегментом
+            if (data.x.size() < firstPoint)
+            {
+                continue;
+            }
+            data.x.resize(firstPoint + points);
+            data.y.resize(firstPoint + points);
+        }
+        else if (firstPoint + points > totalPoints)
+        {
+            continue;
+        }
+        std::copy_n(segment.frequencyKHz.constData(), points, data.x.data() + firstPoint);
+        std::copy_n(y.constData(), points, data.y.data() + firstPoint);
+        computeBounds(data);
+        if (data.x.size() != totalPoints)
+        {
+            // ось X сразу на весь диапазон, чтобы график не прыгал с каждым сегментом
+            data.bounds.xMin = qMin(data.bounds.xMin, qreal(segment.settings.startKHz));
+            data.bounds.xMax = qMax(data.bounds.xMax, qreal(segment.settings.stopKHz));
+        }
+        changed.append(key);
+    }
+
+    if (!changed.isEmpty())
+    {
+        const qreal xMin = _axisX ? _axisX->min() : 0;
+        const qreal xMax = _axisX ? _axisX->max() : 0;
+        _batchUpdate = true;
+        autoScaleAxes();
+        _batchUpdate = false;
+        if (_axisX && (_axisX->min() != xMin || _axisX->max() != xMax))
+        {
+            decimateAll();
+        }
+        else
+        {
+            for (int key : changed)
+            {
+                decimateTrace(key);
+            }
+        }
+        _chart->update();
+    }
+}
+
+const ChartTraceData* CreaterChart::traceData(int traceNum) const
+{
+    auto it = _traceDataMap.constFind(traceNum);
+    return it == _traceDataMap.constEnd() ? nullptr : &it.value();
+}
+
+bool CreaterChart::storeTraceData(int traceNum, const QVector<qreal>& xData, const QVector<qreal>& yData)
 {
     if (!_seriesMap.contains(traceNum))
     {
-        return;
+        return false;
     }
 
-    int minSize = qMin(xData.size(), yData.size());
+    const qsizetype minSize = qMin(xData.size(), yData.size());
     if (minSize == 0)
+    {
+        return false;
+    }
+
+    ChartTraceData& data = _traceDataMap[traceNum];
+    data.x = xData;
+    data.y = yData;
+    if (data.x.size() != minSize) data.x.resize(minSize);
+    if (data.y.size() != minSize) data.y.resize(minSize);
+    computeBounds(data);
+    return true;
+}
+
+int CreaterChart::decimationBuckets() const
+{
+    return _plotWidth > 0 ? _plotWidth : DEFAULT_PLOT_WIDTH_PX;
+}
+
+void CreaterChart::decimateTrace(int traceNum)
+{
+    auto seriesIt = _seriesMap.constFind(traceNum);
+    auto dataIt = _traceDataMap.constFind(traceNum);
+    if (seriesIt == _seriesMap.constEnd() || dataIt == _traceDataMap.constEnd())
     {
         return;
     }
 
-    QLineSeries* series = _seriesMap[traceNum];
-    series->clear();
+    const ChartTraceData& data = dataIt.value();
+    qreal xMin = data.bounds.xMin;
+    qreal xMax = data.bounds.xMax;
+    if (_axisX && _axisX->max() > _axisX->min())
+    {
+        xMin = _axisX->min();
+        xMax = _axisX->max();
+    }
 
-    for (int i = 0; i < minSize; ++i)
+    // Серия получает не больше двух точек на пиксель видимой области,
+    // так что отрисовка зависит от ширины графика, а не от числа точек свипа.
+    QList<QPointF> points;
+    decimateMinMax(data.x.constData(), data.y.constData(), data.x.size(),
+                   xMin, xMax, decimationBuckets(), points);
+    seriesIt.value()->replace(points);
+}
+
+void CreaterChart::decimateAll()
+{
+    for (auto it = _traceDataMap.constBegin(); it != _traceDataMap.constEnd(); ++it)
     {
-        series->append(xData[i], yData[i]);
+        decimateTrace(it.key());
     }
+}
 
-    _chart->update();
+void CreaterChart::onVisibleRangeChanged()
+{
+    if (_batchUpdate)
+    {
+        return;
+    }
+    decimateAll();
+}
+
+void CreaterChart::onPlotAreaChanged(const QRectF& plotArea)
+{
+    const int width = qMax(1, int(plotArea.width()));
+    if (width == _plotWidth)
+    {
+        return;
+    }
+    _plotWidth = width;
+    decimateAll();
 }
 
 void CreaterChart::autoScaleAxes()
 {
-    if (!_axisX || !_axisY || _seriesMap.isEmpty())
+    if (!_axisX || !_axisY || _traceDataMap.isEmpty())
     {
         return;
     }
@@ -145,20 +337,16 @@ void CreaterChart::autoScaleAxes()
 
     bool hasData = false;
 
-    for (QLineSeries* series : _seriesMap)
+    for (const ChartTraceData& data : _traceDataMap)
     {
-        auto points = series->points();
-        if (points.isEmpty()) continue;
+        const TraceBounds& bounds = data.bounds;
+        if (!bounds.valid) continue;
 
         hasData = true;
-
-        for (const QPointF& point : points)
-        {
-            xMin = qMin(xMin, point.x());
-            xMax = qMax(xMax, point.x());
-            yMin = qMin(yMin, point.y());
-            yMax = qMax(yMax, point.y());
-        }
+        xMin = qMin(xMin, bounds.xMin);
+        xMax = qMax(xMax, bounds.xMax);
+        yMin = qMin(yMin, bounds.yMin);
+        yMax = qMax(yMax, bounds.yMax);
     }
 
     if (hasData)
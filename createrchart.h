@@ -7,6 +7,25 @@
 #include <QtCharts/QChart>
 #include <QtCharts/QValueAxis>
 #include <QtCharts/QLineSeries>
+#include "sweepframe.h"
+
+struct TraceBounds
+{
+    qreal xMin = 0;
+    qreal xMax = 0;
+    qreal yMin = 0;
+    qreal yMax = 0;
+    bool valid = false;
+};
+
+// Полное разрешение трассы хранится здесь (для маркеров и экспорта),
+// в QLineSeries попадает только прореженная по ширине графика копия.
+struct ChartTraceData
+{
+    QVector<qreal> x;
+    QVector<qreal> y;
+    TraceBounds bounds;
+};
 
 class CreaterChart : public QObject
 {
@@ -27,16 +46,33 @@ public:
     void clearAllTraces();
 
     void updateTraceData(int traceNum, const QVector<qreal>& xData, const QVector<qreal>& yData);
+    void updateSweep(const SweepFrame& frame, int traceKeyOffset = 0);
+    // Сегмент свипа ложится на место точек firstPoint.. в буфере трассы;
+    // остальные точки показывают предыдущий свип, пока их не перепишут
+    void updateSweepSegment(const SweepFrame& segment, int firstPoint, int totalPoints, int traceKeyOffset = 0);
     void autoScaleAxes();
 
     bool hasTrace(int traceNum) const { return _seriesMap.contains(traceNum); }
     QList<int> getTraceNumbers() const { return _seriesMap.keys(); }
+    const ChartTraceData* traceData(int traceNum) const;
+
+private slots:
+    void onVisibleRangeChanged();
+    void onPlotAreaChanged(const QRectF& plotArea);
 
 private:
+    bool storeTraceData(int traceNum, const QVector<qreal>& xData, const QVector<qreal>& yData);
+    void decimateTrace(int traceNum);
+    void decimateAll();
+    int decimationBuckets() const;
+
     QChart* _chart;
     QValueAxis* _axisX;
     QValueAxis* _axisY;
     QMap<int, QLineSeries*> _seriesMap;
+    QMap<int, ChartTraceData> _traceDataMap;
+    int _plotWidth;
+    bool _batchUpdate;
 };
 
 #endif // CREATERCHART_H
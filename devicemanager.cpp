@@ -0,0 +1,360 @@
+#include "devicemanager.h"
+#include "socket.h"
+#include "sweeprecorder.h"
+#include <QDebug>
+#include <QHostAddress>
+
+DeviceManager::DeviceManager(QObject* parent)
+    : QObject(parent)
+    , _nextDeviceId(0)
+    , _scheduling(SweepScheduling::FreeRunning)
+    , _running(false)
+    , _normalTimeout(15000)
+    , _opcTimeout(45000)
+    , _minSweepInterval(50)
+    , _dataFormat(TraceDataFormat::Ascii)
+    , _littleEndian(false)
+    , _verifyConfiguration(false)
+    , _segmentPoints(0)
+{
+}
+
+DeviceManager::~DeviceManager()
+{
+    shutdown();
+}
+
+int DeviceManager::addDevice(const QString& name, const QString& host, quint16 port)
+{
+    const int deviceId = _nextDeviceId++;
+    Device device;
+    device.name = name.isEmpty() ? QString("VNA%1").arg(deviceId + 1) : name;
+    device.host = host;
+    device.port = port;
+    device.socket = new Socket();
+    device.socket->setTimeouts(_normalTimeout, _opcTimeout, _minSweepInterval);
+    device.socket->setDataTransferMode(_dataFormat, _littleEndian);
+    device.socket->setVerifyConfiguration(_verifyConfiguration);
+    device.socket->setSegmentPoints(_segmentPoints);
+    device.socket->setExternalSweepTrigger(_scheduling == SweepScheduling::Lockstep);
+
+    // Сигналы приходят из потока сокета, обработчики выполняются в потоке менеджера
+    Socket* socket = device.socket;
+    connect(socket, &VNAclient::sweepReady, this, [this, deviceId, socket]() {
+        if (SweepFramePtr frame = socket->takeSweep()) onDeviceSweep(deviceId, frame);
+    });
+    connect(socket, &VNAclient::sweepSegmentReady, this, [this, deviceId](SweepFramePtr segment, int firstPoint, int totalPoints) {
+        emit sweepSegmentReady(deviceId, segment, firstPoint, totalPoints);
+    });
+    connect(socket, &VNAclient::dataFromVNA, this, [this, deviceId](const QByteArray& data, const ScpiCommand& cmd) {
+        emit dataFromDevice(deviceId, data, cmd);
+    });
+    connect(socket, &VNAclient::sweepAborted, this, [this, deviceId]() {
+        onDeviceSweepAborted(deviceId);
+    });
+    connect(socket, &VNAclient::error, this, [this, deviceId](int code, const QString& message) {
+        emit deviceError(deviceId, code, message);
+    });
+    connect(socket, &VNAclient::connected, this, [this, deviceId]() {
+        onDeviceConnected(deviceId);
+    });
+    connect(socket, &VNAclient::disconnected, this, [this, deviceId]() {
+        onDeviceDisconnected(deviceId);
+    });
+
+    _devices.insert(deviceId, device);
+    socket->startThread();
+    qDebug() << "DeviceManager: added" << device.name << host << port << "as device" << deviceId;
+
+    if (isRecording()) {
+        startDeviceRecording(deviceId);
+    }
+    if (_running) {
+        sendSetup(deviceId);
+        startDevice(deviceId);
+    }
+    emit devicesChanged();
+    return deviceId;
+}
+
+bool DeviceManager::removeDevice(int deviceId)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end()) return false;
+    stopDeviceRecording(deviceId);
+    Socket* socket = it->socket;
+    _devices.erase(it);
+    socket->disconnect(this);
+    socket->stopThread();
+    delete socket;
+    qDebug() << "DeviceManager: removed device" << deviceId;
+    completeRoundIfReady();
+    emit devicesChanged();
+    return true;
+}
+
+void DeviceManager::setDeviceAddress(int deviceId, const QString& host, quint16 port)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end()) return;
+    it->host = host;
+    it->port = port;
+    emit devicesChanged();
+}
+
+Socket* DeviceManager::socket(int deviceId) const
+{
+    auto it = _devices.constFind(deviceId);
+    return it == _devices.constEnd() ? nullptr : it->socket;
+}
+
+QString DeviceManager::deviceName(int deviceId) const
+{
+    return _devices.value(deviceId).name;
+}
+
+QString DeviceManager::deviceHost(int deviceId) const
+{
+    return _devices.value(deviceId).host;
+}
+
+quint16 DeviceManager::devicePort(int deviceId) const
+{
+    return _devices.value(deviceId).port;
+}
+
+void DeviceManager::setScheduling(SweepScheduling scheduling)
+{
+    if (scheduling == _scheduling) return;
+    _scheduling = scheduling;
+    for (Device& device : _devices) {
+        // свип, идущий сейчас, и будет первым раундом
+        device.delivered = false;
+        device.socket->setExternalSweepTrigger(scheduling == SweepScheduling::Lockstep);
+    }
+}
+
+void DeviceManager::setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int minSweepIntervalMs)
+{
+    _normalTimeout = normalTimeoutMs;
+    _opcTimeout = opcTimeoutMs;
+    _minSweepInterval = minSweepIntervalMs;
+    for (Device& device : _devices)
+        device.socket->setTimeouts(normalTimeoutMs, opcTimeoutMs, minSweepIntervalMs);
+}
+
+void DeviceManager::setDataTransferMode(TraceDataFormat format, bool littleEndian)
+{
+    _dataFormat = format;
+    _littleEndian = littleEndian;
+    for (Device& device : _devices)
+        device.socket->setDataTransferMode(format, littleEndian);
+}
+
+void DeviceManager::setVerifyConfiguration(bool verify)
+{
+    _verifyConfiguration = verify;
+    for (Device& device : _devices)
+        device.socket->setVerifyConfiguration(verify);
+}
+
+void DeviceManager::setSegmentPoints(int pointsPerSegment)
+{
+    _segmentPoints = pointsPerSegment;
+    for (Device& device : _devices)
+        device.socket->setSegmentPoints(pointsPerSegment);
+}
+
+void DeviceManager::setGraphSettings(const QVector<TraceFetchPlan>& plan, const QVector<ScpiCommand>& setupCommands)
+{
+    _fetchPlan = plan;
+    _setupCommands = setupCommands;
+    for (auto it = _devices.begin(); it != _devices.end(); ++it)
+        sendSetup(it.key());
+}
+
+void DeviceManager::setFetchPlan(const QVector<TraceFetchPlan>& plan)
+{
+    _fetchPlan = plan;
+    for (Device& device : _devices)
+        device.socket->setFetchPlan(plan);
+}
+
+void DeviceManager::sendSetup(int deviceId)
+{
+    const Device& device = _devices[deviceId];
+    device.socket->setFetchPlan(_fetchPlan);
+    QHostAddress host;
+    if (_setupCommands.isEmpty() || !host.setAddress(device.host)) return;
+    // Socket повторяет эти команды сам после переподключения
+    QMetaObject::invokeMethod(device.socket, "setTraceSetup", Qt::QueuedConnection,
+                              Q_ARG(QHostAddress, host),
+                              Q_ARG(quint16, device.port),
+                              Q_ARG(QVector<ScpiCommand>, _setupCommands));
+}
+
+void DeviceManager::startAll(const ScanParameters& params)
+{
+    _scan = params;
+    _running = true;
+    for (auto it = _devices.begin(); it != _devices.end(); ++it)
+        startDevice(it.key());
+}
+
+void DeviceManager::startDevice(int deviceId)
+{
+    Device& device = _devices[deviceId];
+    device.active = true;
+    device.delivered = false;
+    QMetaObject::invokeMethod(device.socket, "startScan", Qt::QueuedConnection,
+                              Q_ARG(QString, device.host),
+                              Q_ARG(quint16, device.port),
+                              Q_ARG(int, _scan.startKHz),
+                              Q_ARG(int, _scan.stopKHz),
+                              Q_ARG(int, _scan.points),
+                              Q_ARG(int, _scan.band),
+                              Q_ARG(double, _scan.powerDbM),
+                              Q_ARG(int, _scan.powerFreqKHz));
+    // в режиме Lockstep прибор, добавленный на ходу, участвует уже в текущем раунде
+    if (_scheduling == SweepScheduling::Lockstep)
+        device.socket->requestSweep();
+}
+
+void DeviceManager::stopAll()
+{
+    _running = false;
+    for (Device& device : _devices) {
+        device.active = false;
+        QMetaObject::invokeMethod(device.socket, "stopScan", Qt::QueuedConnection);
+    }
+}
+
+void DeviceManager::shutdown()
+{
+    _running = false;
+    stopRecording();
+    for (Device& device : _devices) {
+        device.socket->disconnect(this);
+        device.socket->stopThread();
+        delete device.socket;
+    }
+    _devices.clear();
+}
+
+bool DeviceManager::startRecording(const QString& basePath)
+{
+    stopRecording();
+    _recordingBase = basePath;
+    bool ok = true;
+    for (auto it = _devices.begin(); it != _devices.end(); ++it)
+        ok &= startDeviceRecording(it.key());
+    if (!ok) stopRecording();
+    return ok;
+}
+
+void DeviceManager::stopRecording()
+{
+    for (auto it = _devices.begin(); it != _devices.end(); ++it)
+        stopDeviceRecording(it.key());
+    _recordingBase.clear();
+}
+
+QString DeviceManager::recordingPath(int deviceId) const
+{
+    const SweepRecorder* recorder = _devices.value(deviceId).recorder;
+    return recorder ? recorder->path() : QString();
+}
+
+bool DeviceManager::startDeviceRecording(int deviceId)
+{
+    Device& device = _devices[deviceId];
+    SweepRecorder* recorder = new SweepRecorder(this);
+    const QString path = QString("%1-%2.tsweep").arg(_recordingBase, device.name);
+    if (!recorder->open(path)) {
+        emit deviceError(deviceId, -1, QString("Cannot record to %1: %2").arg(path, recorder->errorString()));
+        delete recorder;
+        return false;
+    }
+    connect(recorder, &SweepRecorder::recorderError, this, [this, deviceId](const QString& message) {
+        emit deviceError(deviceId, -1, QString("Recording stopped: %1").arg(message));
+    });
+    device.recorder = recorder;
+    device.socket->setRecorder(recorder);
+    return true;
+}
+
+void DeviceManager::stopDeviceRecording(int deviceId)
+{
+    Device& device = _devices[deviceId];
+    if (!device.recorder) return;
+    device.socket->setRecorder(nullptr);
+    if (device.socket->thread()->isRunning()) {
+        // дождаться, пока поток сокета выйдет из submit(), если он уже там
+        QMetaObject::invokeMethod(device.socket, []() {}, Qt::BlockingQueuedConnection);
+    }
+    device.recorder->close();
+    delete device.recorder;
+    device.recorder = nullptr;
+}
+
+void DeviceManager::onDeviceSweep(int deviceId, SweepFramePtr frame)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end()) return;
+    emit sweepReady(deviceId, frame);
+    if (_scheduling != SweepScheduling::Lockstep) return;
+    it->delivered = true;
+    completeRoundIfReady();
+}
+
+void DeviceManager::onDeviceSweepAborted(int deviceId)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end() || _scheduling != SweepScheduling::Lockstep || !it->active) return;
+    // свип этого прибора в текущем раунде потерян — остальные не ждут
+    it->delivered = true;
+    completeRoundIfReady();
+}
+
+void DeviceManager::onDeviceConnected(int deviceId)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end() || !_running || it->active) return;
+    // связь восстановлена, Socket сам повторил настройку — прибор снова в цикле
+    qDebug() << "DeviceManager: device" << deviceId << "reconnected";
+    it->active = true;
+    it->delivered = false;
+    if (_scheduling == SweepScheduling::Lockstep)
+        it->socket->requestSweep();
+}
+
+void DeviceManager::onDeviceDisconnected(int deviceId)
+{
+    auto it = _devices.find(deviceId);
+    if (it == _devices.end()) return;
+    it->active = false;
+    completeRoundIfReady();
+}
+
+void DeviceManager::completeRoundIfReady()
+{
+    if (!_running || _scheduling != SweepScheduling::Lockstep) return;
+    bool anyActive = false;
+    for (const Device& device : _devices) {
+        if (!device.active) continue;
+        anyActive = true;
+        if (!device.delivered) return;
+    }
+    if (!anyActive) return;
+
+    for (Device& device : _devices)
+        device.delivered = false;
+    requestRound();
+}
+
+void DeviceManager::requestRound()
+{
+    for (Device& device : _devices) {
+        if (device.active) device.socket->requestSweep();
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef DEVICEMANAGER_H
+#define DEVICEMANAGER_H
+
+#include "sweepframe.h"
+#include "vnacomand.h"
+#include <QObject>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+class Socket;
+class SweepRecorder;
+
+// Номер трассы на графике: трассы разных приборов не пересекаются,
+// прибор 0 сохраняет прежнюю нумерацию.
+#define DEVICE_TRACE_STRIDE 100
+
+enum class SweepScheduling
+{
+    FreeRunning,    // каждый прибор свипирует в своём темпе
+    Lockstep        // следующий свип всех приборов — после прихода данных от каждого
+};
+
+// Владеет Socket (и его потоком) для каждого прибора, раздаёт им общие
+// настройки и сводит свипы в один поток сигналов с номером прибора.
+class DeviceManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceManager(QObject* parent = nullptr);
+    ~DeviceManager();
+
+    static int chartTraceKey(int deviceId, int traceNum) { return deviceId * DEVICE_TRACE_STRIDE + traceNum; }
+
+    int addDevice(const QString& name, const QString& host, quint16 port);
+    bool removeDevice(int deviceId);
+    void setDeviceAddress(int deviceId, const QString& host, quint16 port);
+
+    QList<int> deviceIds() const { return _devices.keys(); }
+    int primaryDevice() const { return _devices.isEmpty() ? -1 : _devices.firstKey(); }
+    Socket* socket(int deviceId) const;
+    QString deviceName(int deviceId) const;
+    QString deviceHost(int deviceId) const;
+    quint16 devicePort(int deviceId) const;
+    bool isRunning() const { return _running; }
+
+    // Можно и во время свипов: на Lockstep приборы переходят по окончании текущего свипа
+    void setScheduling(SweepScheduling scheduling);
+    SweepScheduling scheduling() const { return _scheduling; }
+    void setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int minSweepIntervalMs);
+    void setDataTransferMode(TraceDataFormat format, bool littleEndian);
+    void setVerifyConfiguration(bool verify);
+    // Точек в сегменте широкого свипа, 0 — свип целиком (Socket::setSegmentPoints)
+    void setSegmentPoints(int pointsPerSegment);
+
+    // Команды настройки и план опроса запоминаются и отправляются и приборам, добавленным позже
+    void setGraphSettings(const QVector<TraceFetchPlan>& plan, const QVector<ScpiCommand>& setupCommands);
+    // Смена приоритетов опроса без перенастройки приборов
+    void setFetchPlan(const QVector<TraceFetchPlan>& plan);
+
+    void startAll(const ScanParameters& params);
+    void stopAll();
+    void shutdown();
+
+    // Запись свипов каждого прибора в свой файл <basePath>-<имя прибора>.tsweep
+    bool startRecording(const QString& basePath);
+    void stopRecording();
+    bool isRecording() const { return !_recordingBase.isEmpty(); }
+    QString recordingPath(int deviceId) const;
+
+signals:
+    void devicesChanged();
+    void sweepReady(int deviceId, SweepFramePtr frame);
+    void sweepSegmentReady(int deviceId, SweepFramePtr segment, int firstPoint, int totalPoints);
+    void dataFromDevice(int deviceId, const QByteArray& data, const ScpiCommand& cmd);
+    void deviceError(int deviceId, int code, const QString& message);
+
+private:
+    struct Device
+    {
+        QString name;
+        QString host;
+        quint16 port = 0;
+        Socket* socket = nullptr;
+        bool active = false;        // участвует в текущем цикле свипов
+        bool delivered = false;     // свип текущего раунда (Lockstep) закончен
+        SweepRecorder* recorder = nullptr;
+    };
+
+    void startDevice(int deviceId);
+    void sendSetup(int deviceId);
+    void onDeviceSweep(int deviceId, SweepFramePtr frame);
+    void onDeviceSweepAborted(int deviceId);
+    void onDeviceConnected(int deviceId);
+    void onDeviceDisconnected(int deviceId);
+    void completeRoundIfReady();
+    void requestRound();
+    bool startDeviceRecording(int deviceId);
+    void stopDeviceRecording(int deviceId);
+
+    QMap<int, Device> _devices;
+    int _nextDeviceId;
+    SweepScheduling _scheduling;
+    bool _running;
+    ScanParameters _scan;
+
+    int _normalTimeout;
+    int _opcTimeout;
+    int _minSweepInterval;
+    TraceDataFormat _dataFormat;
+    bool _littleEndian;
+    bool _verifyConfiguration;
+    int _segmentPoints;
+
+    QVector<TraceFetchPlan> _fetchPlan;
+    QVector<ScpiCommand> _setupCommands;
+    QString _recordingBase;
+};
+
+#endif // DEVICEMANAGER_H
@@ -1,13 +1,14 @@
 #include "widget.h"
-#include "socket.h"
+#include "devicemanager.h"
 #include <QApplication>
 #include <QDebug>
 
 int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
-    Socket* vnaClient = new Socket();
-    Widget w(vnaClient);
+    DeviceManager devices;
+    devices.addDevice(QString(), "127.0.0.1", 5025);
+    Widget w(&devices);
     w.show();
     return app.exec();
 }
@@ -0,0 +1,424 @@
+#include "replayclient.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+
+// Сколько свипов подряд разбирается без возврата в цикл событий при
+// REPLAY_MAX_SPEED: остановка и перемотка срабатывают не позже этого
+#define REPLAY_MAX_SWEEPS_PER_STEP 1
+
+static const CaptureRecordHeader* captureRecord(const uchar* base, quint64 size, quint64 offset)
+{
+    if (offset + sizeof(CaptureRecordHeader) > size) return nullptr;
+    const auto* header = reinterpret_cast<const CaptureRecordHeader*>(base + offset);
+    if (header->kind < CaptureTx || header->kind > CaptureSweepEnd) return nullptr;
+    if (captureRecordSize(header->size) > size - offset) return nullptr;
+    return header;
+}
+
+static int traceFromHeader(const char* begin, const char* end)
+{
+    static const char tag[] = "TRAC";
+    const char* it = std::search(begin, end, tag, tag + 4);
+    if (it == end) return 0;
+    it += 4;
+    int trace = 0;
+    while (it < end && *it >= '0' && *it <= '9')
+        trace = trace * 10 + (*it++ - '0');
+    return trace;
+}
+
+ReplayClient::ReplayClient(QObject* parent)
+    : VNAclient(parent)
+    , _thread(nullptr)
+    , _timer(nullptr)
+    , _data(nullptr)
+    , _size(0)
+    , _cursor(0)
+    , _sweepTotal(0)
+    , _sweepIndex(-1)
+    , _playing(false)
+    , _looping(false)
+    , _speed(1.0)
+    , _anchorClockNs(0)
+    , _anchorCaptureNs(0)
+    , _dataFormat(TraceDataFormat::Ascii)
+    , _littleEndian(false)
+{
+    _thread = new QThread();
+    this->moveToThread(_thread);
+    connect(_thread, &QThread::started, this, &ReplayClient::initializeInThread);
+    connect(_thread, &QThread::finished, this, &ReplayClient::cleanupInThread);
+}
+
+ReplayClient::~ReplayClient()
+{
+    stopThread();
+    closeInThread();
+    delete _thread;
+}
+
+VNAclient* ReplayClient::getInstance()
+{
+    return this;
+}
+
+void ReplayClient::startThread()
+{
+    if (_thread && !_thread->isRunning()) {
+        _thread->start();
+    }
+}
+
+void ReplayClient::stopThread()
+{
+    if (!_thread || !_thread->isRunning()) return;
+    _thread->quit();
+    _thread->wait();
+}
+
+void ReplayClient::initializeInThread()
+{
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    _timer->setTimerType(Qt::PreciseTimer);
+    connect(_timer, &QTimer::timeout, this, &ReplayClient::step);
+    _clock.start();
+}
+
+void ReplayClient::cleanupInThread()
+{
+    _playing = false;
+    delete _timer;
+    _timer = nullptr;
+}
+
+bool ReplayClient::open(const QString& path)
+{
+    if (_thread->isRunning() && QThread::currentThread() != _thread) {
+        bool ok = false;
+        QMetaObject::invokeMethod(this, [this, path, &ok]() { ok = openInThread(path); }, Qt::BlockingQueuedConnection);
+        return ok;
+    }
+    return openInThread(path);
+}
+
+void ReplayClient::close()
+{
+    if (_thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { closeInThread(); }, Qt::BlockingQueuedConnection);
+        return;
+    }
+    closeInThread();
+}
+
+QString ReplayClient::errorString() const
+{
+    QMutexLocker locker(&_errorMutex);
+    return _error;
+}
+
+void ReplayClient::setSpeed(double speed)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, speed]() { setSpeed(speed); }, Qt::QueuedConnection);
+        return;
+    }
+    _speed = qMax(0.0, speed);
+    anchor();
+    if (_playing && _timer) _timer->start(0);
+}
+
+void ReplayClient::setLooping(bool looping)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, looping]() { setLooping(looping); }, Qt::QueuedConnection);
+        return;
+    }
+    _looping = looping;
+}
+
+bool ReplayClient::openInThread(const QString& path)
+{
+    closeInThread();
+    QString error;
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        error = _file.errorString();
+    } else {
+        _size = quint64(_file.size());
+        _data = _size >= sizeof(SessionCaptureHeader) ? _file.map(0, qint64(_size)) : nullptr;
+        SessionCaptureHeader header;
+        if (_data) std::memcpy(&header, _data, sizeof(header));
+        if (!_data || std::memcmp(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != CAPTURE_FILE_VERSION) {
+            error = QString("%1: not a session capture").arg(path);
+        } else {
+            _cursor = header.headerSize;
+            buildIndex();
+        }
+    }
+    {
+        QMutexLocker locker(&_errorMutex);
+        _error = error;
+    }
+    if (!error.isEmpty()) {
+        qWarning() << "ReplayClient:" << error;
+        closeInThread();
+        return false;
+    }
+    qDebug() << "ReplayClient: opened" << path << "sweeps:" << _sweepOffsets.size();
+    return true;
+}
+
+void ReplayClient::closeInThread()
+{
+    _playing = false;
+    if (_timer) _timer->stop();
+    resetStream();
+    if (_data) _file.unmap(const_cast<uchar*>(_data));
+    _data = nullptr;
+    _size = 0;
+    _cursor = 0;
+    _file.close();
+    _sweepOffsets.clear();
+    _frequencyKHz.clear();
+    _sweepTimes.clear();
+    _sweepTotal.store(0, std::memory_order_release);
+    _sweepIndex = -1;
+}
+
+void ReplayClient::buildIndex()
+{
+    // Только заголовки записей, данные не читаются. Хвост, оборванный при
+    // падении записи, отбрасывается.
+    quint64 offset = _cursor;
+    while (const CaptureRecordHeader* record = captureRecord(_data, _size, offset)) {
+        if (record->kind == CaptureSweepBegin && record->size >= sizeof(CaptureSweepMark)) {
+            CaptureSweepMark mark;
+            std::memcpy(&mark, _data + offset + sizeof(CaptureRecordHeader), sizeof(mark));
+            _sweepOffsets.append(offset);
+            _sweepTimes.append(mark.wallMs);
+        }
+        offset += captureRecordSize(record->size);
+    }
+    _size = offset;
+    _sweepTotal.store(_sweepOffsets.size(), std::memory_order_release);
+}
+
+void ReplayClient::resetStream()
+{
+    _framer.clear();
+    _queries.clear();
+    _frame.reset();
+}
+
+void ReplayClient::anchor()
+{
+    // Время записи, с которым сравнивается текущее время воспроизведения
+    _anchorClockNs = _clock.isValid() ? _clock.nsecsElapsed() : 0;
+    const CaptureRecordHeader* record = _data ? captureRecord(_data, _size, _cursor) : nullptr;
+    _anchorCaptureNs = record ? record->elapsedNs : 0;
+}
+
+void ReplayClient::startScan(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz)
+{
+    Q_UNUSED(ip); Q_UNUSED(port); Q_UNUSED(startKHz); Q_UNUSED(stopKHz);
+    Q_UNUSED(points); Q_UNUSED(band); Q_UNUSED(powerDbM); Q_UNUSED(powerFreqKHz);
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { startScan(QString(), 0, 0, 0, 0, 0, 0.0, 0); }, Qt::QueuedConnection);
+        return;
+    }
+    if (!_data || _playing) return;
+    _playing = true;
+    anchor();
+    emit connected();
+    _timer->start(0);
+}
+
+void ReplayClient::stopScan()
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, "stopScan", Qt::QueuedConnection);
+        return;
+    }
+    _playing = false;
+    if (_timer) _timer->stop();
+}
+
+void ReplayClient::sendCommand(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands)
+{
+    // прибора нет — команды настройки уже учтены в записи
+    Q_UNUSED(host); Q_UNUSED(port); Q_UNUSED(commands);
+}
+
+void ReplayClient::setGraphSettings(int graphCount, const QVector<int>& traceNumbers)
+{
+    Q_UNUSED(graphCount); Q_UNUSED(traceNumbers);
+}
+
+void ReplayClient::seekToSweep(int index)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, index]() { seekToSweep(index); }, Qt::QueuedConnection);
+        return;
+    }
+    if (_sweepOffsets.isEmpty()) return;
+    index = qBound(0, index, int(_sweepOffsets.size()) - 1);
+    resetStream();
+    _cursor = _sweepOffsets[index];
+    _sweepIndex = index - 1;
+    anchor();
+    if (_playing && _timer) _timer->start(0);
+}
+
+void ReplayClient::seekToTime(qint64 wallMs)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, wallMs]() { seekToTime(wallMs); }, Qt::QueuedConnection);
+        return;
+    }
+    const auto it = std::lower_bound(_sweepTimes.constBegin(), _sweepTimes.constEnd(), wallMs);
+    seekToSweep(int(it - _sweepTimes.constBegin()));
+}
+
+void ReplayClient::step()
+{
+    if (!_playing || !_data) return;
+    int sweeps = 0;
+    for (;;) {
+        const CaptureRecordHeader* record = captureRecord(_data, _size, _cursor);
+        if (!record) {
+            if (_looping && !_sweepOffsets.isEmpty()) {
+                seekToSweep(0);
+                return;
+            }
+            _playing = false;
+            qDebug() << "ReplayClient: end of capture";
+            emit finished();
+            return;
+        }
+        if (_speed > 0.0) {
+            const qint64 dueNs = _anchorClockNs + qint64(double(record->elapsedNs - _anchorCaptureNs) / _speed);
+            const qint64 waitNs = dueNs - _clock.nsecsElapsed();
+            if (waitNs > 1000000) {
+                _timer->start(int(waitNs / 1000000));
+                return;
+            }
+        } else if (sweeps >= REPLAY_MAX_SWEEPS_PER_STEP) {
+            _timer->start(0);
+            return;
+        }
+
+        const uchar* payload = _data + _cursor + sizeof(CaptureRecordHeader);
+        _cursor += captureRecordSize(record->size);
+        switch (record->kind) {
+        case CaptureTx:
+            processTx(reinterpret_cast<const char*>(payload), record->size);
+            break;
+        case CaptureRx:
+            processRx(reinterpret_cast<const char*>(payload), record->size);
+            break;
+        default:
+            processSweepMark(record->kind, payload, record->size);
+            if (record->kind == CaptureSweepEnd) ++sweeps;
+            break;
+        }
+    }
+}
+
+void ReplayClient::processTx(const char* data, qsizetype size)
+{
+    // Запросы Socket всегда отправляет отдельной строкой, по ответу на строку
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end) {
+        const char* lineEnd = std::find(line, end, '\n');
+        const char* headerEnd = std::find(line, lineEnd, ' ');
+        if (headerEnd > line && headerEnd[-1] == '?') {
+            PendingQuery query;
+            const QByteArray header = QByteArray::fromRawData(line, headerEnd - line);
+            if (header.contains("FDAT")) {
+                query.id = ScpiId::TraceData;
+            } else if (header.contains("XAX")) {
+                query.id = ScpiId::TraceXAxis;
+            }
+            query.trace = traceFromHeader(line, headerEnd);
+            _queries.enqueue(query);
+        }
+        line = lineEnd + 1;
+    }
+}
+
+void ReplayClient::processRx(const char* data, qsizetype size)
+{
+    _framer.append(data, size);
+    QByteArray reply;
+    while (_framer.takeReply(reply)) {
+        if (_queries.isEmpty()) {
+            qWarning() << "ReplayClient: reply without a query," << reply.size() << "bytes";
+            continue;
+        }
+        processReply(_queries.dequeue(), reply);
+    }
+}
+
+void ReplayClient::processReply(const PendingQuery& query, const QByteArray& reply)
+{
+    if (query.id == ScpiId::Raw) return;
+    if (!_frame) {
+        // одиночный запрос вне свипа — как у Socket, ответ уходит в dataFromVNA
+        ScpiCommand command = query.id == ScpiId::TraceData ? makeScpi<ScpiId::TraceData>(query.trace)
+                                                            : makeScpi<ScpiId::TraceXAxis>(query.trace);
+        command.dataFormat = _dataFormat;
+        command.littleEndian = _littleEndian;
+        emit dataFromVNA(reply, command);
+        return;
+    }
+    // сегментированный свип приходит несколькими ответами подряд — они склеиваются
+    if (query.id == ScpiId::TraceData) {
+        _frame->traces[query.trace].append(parseReply<ScpiId::TraceData>(reply, _dataFormat, _littleEndian));
+    } else {
+        _frame->frequencyKHz += parseFrequencyKHz(reply, _dataFormat, _littleEndian);
+    }
+}
+
+void ReplayClient::processSweepMark(quint8 kind, const uchar* payload, quint32 size)
+{
+    if (size < sizeof(CaptureSweepMark)) return;
+    CaptureSweepMark mark;
+    std::memcpy(&mark, payload, sizeof(mark));
+    if (kind == CaptureSweepBegin) {
+        _dataFormat = TraceDataFormat(mark.dataFormat);
+        _littleEndian = mark.littleEndian != 0;
+        _frame = std::make_shared<SweepFrame>();
+        _frame->sequence = mark.sequence;
+        _frame->startedMs = mark.wallMs;
+        _frame->settings.startKHz = mark.startKHz;
+        _frame->settings.stopKHz = mark.stopKHz;
+        _frame->settings.points = mark.points;
+        _frame->settings.band = mark.band;
+        _frame->settings.powerDbM = mark.powerDbM;
+        _frame->settings.powerFreqKHz = mark.powerFreqKHz;
+        emit positionChanged(++_sweepIndex);
+        return;
+    }
+    std::shared_ptr<SweepFrame> frame = std::move(_frame);
+    _frame.reset();
+    if (!mark.ok || !frame || frame->traces.isEmpty()) return;
+    const qsizetype points = frame->traces.first().size();
+    if (frame->frequencyKHz.isEmpty() && _frequencyKHz.size() == points) {
+        // Socket перечитывает ось только после перенастройки
+        frame->frequencyKHz = _frequencyKHz;
+    } else if (frame->frequencyKHz.size() == points) {
+        _frequencyKHz = frame->frequencyKHz;
+    } else {
+        frame->frequencyKHz.resize(points);
+        for (qsizetype i = 0; i < points; ++i)
+            frame->frequencyKHz[i] = double(i);
+    }
+    frame->completedMs = mark.wallMs;
+    publishSweep(SweepFramePtr(std::move(frame)));
+}
@@ -0,0 +1,104 @@
+#ifndef REPLAYCLIENT_H
+#define REPLAYCLIENT_H
+
+#include "vnaclient.h"
+#include "scpiframer.h"
+#include "sessioncapture.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+
+// Скорость воспроизведения: 1 — как было записано, N — в N раз быстрее
+#define REPLAY_MAX_SPEED 0.0   // без пауз, насколько успевает разбор
+
+// Воспроизводит запись сеанса (Socket::startCapture) в отдельном потоке:
+// ответы прибора заново проходят через ScpiFramer и разбор трасс и
+// отдаются теми же сигналами, что и у Socket.
+class ReplayClient : public VNAclient
+{
+    Q_OBJECT
+
+public:
+    explicit ReplayClient(QObject* parent = nullptr);
+    ~ReplayClient();
+
+    VNAclient* getInstance() override;
+    void startThread();
+    void stopThread();
+
+    // Методы ниже можно вызывать из любого потока
+    bool open(const QString& path);
+    void close();
+    QString errorString() const;
+    int sweepCount() const { return _sweepTotal.load(std::memory_order_acquire); }
+    void setSpeed(double speed);
+    void setLooping(bool looping);
+
+signals:
+    void positionChanged(int sweepIndex);
+    void finished();
+
+public slots:
+    // Адрес и параметры не используются: воспроизведение с текущей позиции
+    void startScan(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz) override;
+    void stopScan() override;
+    void sendCommand(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands) override;
+    void setGraphSettings(int graphCount, const QVector<int>& traceNumbers) override;
+    void seekToSweep(int index);
+    void seekToTime(qint64 wallMs);
+
+private slots:
+    void initializeInThread();
+    void cleanupInThread();
+    void step();
+
+private:
+    struct PendingQuery
+    {
+        ScpiId id = ScpiId::Raw;    // TraceXAxis, TraceData или Raw для прочих запросов
+        int trace = 0;
+    };
+
+    bool openInThread(const QString& path);
+    void closeInThread();
+    void buildIndex();
+    void resetStream();
+    void anchor();
+    void processTx(const char* data, qsizetype size);
+    void processRx(const char* data, qsizetype size);
+    void processReply(const PendingQuery& query, const QByteArray& reply);
+    void processSweepMark(quint8 kind, const uchar* payload, quint32 size);
+
+    QThread* _thread;
+    QTimer* _timer;
+    QFile _file;
+    const uchar* _data;
+    quint64 _size;
+    quint64 _cursor;
+    QVector<quint64> _sweepOffsets;     // смещения отметок CaptureSweepBegin
+    QVector<qint64> _sweepTimes;        // и их wallMs, для seekToTime
+    std::atomic<int> _sweepTotal;
+    int _sweepIndex;
+    QString _error;
+    mutable QMutex _errorMutex;
+
+    bool _playing;
+    bool _looping;
+    double _speed;
+    QElapsedTimer _clock;
+    qint64 _anchorClockNs;
+    qint64 _anchorCaptureNs;
+
+    ScpiFramer _framer;
+    QQueue<PendingQuery> _queries;
+    std::shared_ptr<SweepFrame> _frame;
+    QVector<double> _frequencyKHz;      // последняя полная ось X
+    TraceDataFormat _dataFormat;
+    bool _littleEndian;
+};
+
+#endif // REPLAYCLIENT_H
@@ -0,0 +1,101 @@
+#include "scpiframer.h"
+#include <QIODevice>
+#include <cstring>
+
+#define FRAMER_INITIAL_CAPACITY 64 * 1024
+
+ScpiFramer::ScpiFramer()
+    : _readPos(0)
+{
+    _buffer.reserve(FRAMER_INITIAL_CAPACITY);
+}
+
+qint64 ScpiFramer::readFrom(QIODevice* device)
+{
+    const qint64 available = device->bytesAvailable();
+    if (available <= 0) return 0;
+    compact();
+    const qsizetype oldSize = _buffer.size();
+    _buffer.resize(oldSize + available);
+    const qint64 got = device->read(_buffer.data() + oldSize, available);
+    _buffer.resize(oldSize + qMax<qint64>(got, 0));
+    return got;
+}
+
+void ScpiFramer::append(const char* data, qsizetype size)
+{
+    compact();
+    _buffer.append(data, size);
+}
+
+bool ScpiFramer::takeReply(QByteArray& reply)
+{
+    // Перевод строки после двоичного блока может прийти отдельным сегментом —
+    // пустые строки ответом не считаем.
+    while (_readPos < _buffer.size() && (_buffer.at(_readPos) == '\n' || _buffer.at(_readPos) == '\r'))
+        ++_readPos;
+
+    qsizetype terminatorLength = 0;
+    const qsizetype length = frameLength(terminatorLength);
+    if (length < 0) return false;
+
+    reply = _buffer.mid(_readPos, length);
+    _readPos += length + terminatorLength;
+    if (_readPos == _buffer.size()) {
+        _buffer.resize(0);
+        _readPos = 0;
+    }
+    return true;
+}
+
+void ScpiFramer::clear()
+{
+    _buffer.resize(0);
+    _readPos = 0;
+}
+
+qsizetype ScpiFramer::frameLength(qsizetype& terminatorLength) const
+{
+    const qsizetype available = _buffer.size() - _readPos;
+    if (available <= 0) return -1;
+    const char* begin = _buffer.constData() + _readPos;
+
+    // #<n><len><payload> — длина известна из заголовка, '\n' внутри payload не терминатор
+    if (begin[0] == '#' && available >= 2 && begin[1] > '0' && begin[1] <= '9') {
+        const int digits = begin[1] - '0';
+        if (available < 2 + digits) return -1;
+        qsizetype payload = 0;
+        for (int i = 0; i < digits; ++i) {
+            const char c = begin[2 + i];
+            if (c < '0' || c > '9') return -1;
+            payload = payload * 10 + (c - '0');
+        }
+        const qsizetype length = 2 + digits + payload;
+        if (available < length) return -1;
+        terminatorLength = 0;
+        if (available > length && begin[length] == '\r') ++terminatorLength;
+        if (available > length + terminatorLength && begin[length + terminatorLength] == '\n') ++terminatorLength;
+        return length;
+    }
+
+    const char* nl = static_cast<const char*>(std::memchr(begin, '\n', size_t(available)));
+    if (!nl) return -1;
+    qsizetype length = nl - begin;
+    terminatorLength = 1;
+    if (length > 0 && begin[length - 1] == '\r') {
+        --length;
+        ++terminatorLength;
+    }
+    return length;
+}
+
+void ScpiFramer::compact()
+{
+    if (_readPos == 0) return;
+    if (_readPos == _buffer.size()) {
+        _buffer.resize(0);
+    } else {
+        _buffer.remove(0, _readPos);
+    }
+    _readPos = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef SCPIFRAMER_H
+#define SCPIFRAMER_H
+
+#include <QByteArray>
+
+class QIODevice;
+
+class ScpiFramer
+{
+public:
+    ScpiFramer();
+
+    qint64 readFrom(QIODevice* device);
+    void append(const char* data, qsizetype size);
+    bool takeReply(QByteArray& reply);
+    void clear();
+
+    qsizetype bufferedBytes() const { return _buffer.size() - _readPos; }
+    // Последние bytes байт буфера — то, что только что прочитал readFrom()
+    const char* tail(qsizetype bytes) const { return _buffer.constData() + _buffer.size() - bytes; }
+
+private:
+    qsizetype frameLength(qsizetype& terminatorLength) const;
+    void compact();
+
+    QByteArray _buffer;
+    qsizetype _readPos;
+};
+
+#endif // SCPIFRAMER_H
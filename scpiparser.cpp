@@ -0,0 +1,89 @@
+#include "scpiparser.h"
+#include <charconv>
+#include <cstring>
+#include <cmath>
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Одно значение: пропускает пробелы и '+', которые std::from_chars не принимает.
+// При ошибке разбора возвращает NaN, pos переходит на следующий разделитель.
+static inline const char* scanValue(const char* pos, const char* end, double& value, bool& ok)
+{
+    while (pos < end && isBlank(*pos)) ++pos;
+    if (pos < end && *pos == '+') ++pos;
+    const std::from_chars_result res = std::from_chars(pos, end, value);
+    ok = res.ec == std::errc();
+    pos = res.ptr;
+    if (pos < end && *pos != ',') {
+        const void* comma = std::memchr(pos, ',', size_t(end - pos));
+        pos = comma ? static_cast<const char*>(comma) : end;
+    }
+    return pos;
+}
+
+qsizetype scpiValueCount(const char* begin, const char* end)
+{
+    while (end > begin && isBlank(end[-1])) --end;
+    if (begin == end) return 0;
+    qsizetype count = 1;
+    // memchr в libc векторизован — это и есть быстрый поиск разделителей
+    for (const char* p = begin; (p = static_cast<const char*>(std::memchr(p, ',', size_t(end - p)))); ++p)
+        ++count;
+    return count;
+}
+
+qsizetype parseScpiReals(const char* begin, const char* end, double* out, qsizetype capacity,
+                         int stride, int phase)
+{
+    if (stride < 1) stride = 1;
+    qsizetype written = 0;
+    int index = 0;
+    const char* pos = begin;
+    while (pos < end && written < capacity) {
+        if (index == phase) {
+            double value = 0.0;
+            bool ok = false;
+            pos = scanValue(pos, end, value, ok);
+            if (ok) out[written++] = value;
+        } else {
+            const void* comma = std::memchr(pos, ',', size_t(end - pos));
+            pos = comma ? static_cast<const char*>(comma) : end;
+        }
+        if (++index == stride) index = 0;
+        if (pos < end) ++pos;
+    }
+    return written;
+}
+
+qsizetype parseScpiComplex(const char* begin, const char* end, double* re, double* im, qsizetype capacity)
+{
+    qsizetype written = 0;
+    const char* pos = begin;
+    while (pos < end && written < capacity) {
+        double r = 0.0;
+        double i = 0.0;
+        bool okRe = false;
+        bool okIm = false;
+        pos = scanValue(pos, end, r, okRe);
+        if (pos < end) ++pos;
+        if (pos >= end) {
+            if (okRe) {
+                re[written] = r;
+                im[written] = 0.0;
+                ++written;
+            }
+            break;
+        }
+        pos = scanValue(pos, end, i, okIm);
+        if (pos < end) ++pos;
+        if (okRe) {
+            re[written] = r;
+            im[written] = okIm ? i : std::nan("");
+            ++written;
+        }
+    }
+    return written;
+}
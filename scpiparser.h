@@ -0,0 +1,19 @@
+#ifndef SCPIPARSER_H
+#define SCPIPARSER_H
+
+#include <QtGlobal>
+
+// Разбор ответов SCPI вида "v0,v1,v2,..." прямо из байтов ответа,
+// без QString/QStringList и без выделения памяти.
+
+qsizetype scpiValueCount(const char* begin, const char* end);
+
+// Пишет в out каждое stride-е значение начиная с phase (stride = 2, phase = 0 —
+// действительные части пар re,im). Возвращает число записанных значений.
+qsizetype parseScpiReals(const char* begin, const char* end, double* out, qsizetype capacity,
+                         int stride = 1, int phase = 0);
+
+// Разбирает пары re,im в два раздельных массива.
+qsizetype parseScpiComplex(const char* begin, const char* end, double* re, double* im, qsizetype capacity);
+
+#endif // SCPIPARSER_H
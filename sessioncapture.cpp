@@ -0,0 +1,91 @@
+#include "sessioncapture.h"
+#include <QDateTime>
+#include <cstring>
+
+#define CAPTURE_FILE_BUFFER_BYTES (1024 * 1024)
+
+SessionCapture::SessionCapture()
+    : _written(0)
+{
+}
+
+SessionCapture::~SessionCapture()
+{
+    close();
+}
+
+bool SessionCapture::open(const QString& path)
+{
+    close();
+    _error.clear();
+    _written = 0;
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        _error = _file.errorString();
+        return false;
+    }
+    SessionCaptureHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_FILE_VERSION;
+    header.headerSize = sizeof(SessionCaptureHeader);
+    header.createdMs = QDateTime::currentMSecsSinceEpoch();
+    if (_file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))) {
+        _error = _file.errorString();
+        _file.close();
+        return false;
+    }
+    _written = sizeof(header);
+    _clock.start();
+    return true;
+}
+
+void SessionCapture::close()
+{
+    if (!_file.isOpen()) return;
+    _file.flush();
+    _file.close();
+}
+
+bool SessionCapture::write(CaptureRecordKind kind, const char* data, qsizetype size)
+{
+    if (!_file.isOpen()) return false;
+    static const char padding[8] = {};
+    CaptureRecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.kind = kind;
+    header.size = quint32(size);
+    header.elapsedNs = _clock.nsecsElapsed();
+    const qint64 pad = qint64(captureRecordSize(header.size) - sizeof(header)) - size;
+    if (_file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))
+        || _file.write(data, size) != size
+        || (pad > 0 && _file.write(padding, pad) != pad)) {
+        // запись сеанса не должна мешать обмену с прибором — просто прекращаем её
+        _error = _file.errorString();
+        _file.close();
+        return false;
+    }
+    _written += captureRecordSize(header.size);
+    // большие ответы уходят на диск сразу, мелкие копятся в буфере
+    if (_file.bytesToWrite() > CAPTURE_FILE_BUFFER_BYTES) _file.flush();
+    return true;
+}
+
+bool SessionCapture::writeSweepMark(CaptureRecordKind kind, quint64 sequence, qint64 wallMs, const ScanParameters& settings,
+                                    TraceDataFormat format, bool littleEndian, bool ok)
+{
+    CaptureSweepMark mark;
+    std::memset(&mark, 0, sizeof(mark));
+    mark.sequence = sequence;
+    mark.wallMs = wallMs;
+    mark.startKHz = settings.startKHz;
+    mark.stopKHz = settings.stopKHz;
+    mark.points = settings.points;
+    mark.band = settings.band;
+    mark.powerDbM = settings.powerDbM;
+    mark.powerFreqKHz = settings.powerFreqKHz;
+    mark.dataFormat = quint8(format);
+    mark.littleEndian = littleEndian ? 1 : 0;
+    mark.ok = ok ? 1 : 0;
+    return write(kind, reinterpret_cast<const char*>(&mark), sizeof(mark));
+}
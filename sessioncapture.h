@@ -0,0 +1,93 @@
+#ifndef SESSIONCAPTURE_H
+#define SESSIONCAPTURE_H
+
+#include "sweepframe.h"
+#include "vnacomand.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+// Запись сеанса SCPI (*.tcap) как есть: байты, ушедшие в прибор и пришедшие
+// от него, плюс отметки начала и конца свипа. По такой записи ReplayClient
+// воспроизводит сеанс через тот же разбор ответов, что и живой Socket.
+//   SessionCaptureHeader (32 байта)
+//   записи подряд: CaptureRecordHeader, данные, выравнивание до 8 байт
+// Все поля в порядке байт хоста.
+
+#define CAPTURE_FILE_MAGIC "TAIRCAP1"
+#define CAPTURE_FILE_VERSION 1
+
+enum CaptureRecordKind : quint8
+{
+    CaptureTx = 1,          // строки команд, как они ушли в сокет
+    CaptureRx = 2,          // байты, прочитанные из сокета
+    CaptureSweepBegin = 3,  // CaptureSweepMark перед TRIG:SING
+    CaptureSweepEnd = 4     // CaptureSweepMark после чтения всех трасс
+};
+
+struct SessionCaptureHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 headerSize;
+    qint64 createdMs;
+    quint8 reserved[8];
+};
+
+struct CaptureRecordHeader
+{
+    quint8 kind;
+    quint8 reserved[3];
+    quint32 size;           // без заголовка и выравнивания
+    qint64 elapsedNs;       // от открытия записи
+};
+
+struct CaptureSweepMark
+{
+    quint64 sequence;
+    qint64 wallMs;
+    qint32 startKHz;
+    qint32 stopKHz;
+    qint32 points;
+    qint32 band;
+    double powerDbM;
+    qint32 powerFreqKHz;
+    quint8 dataFormat;      // TraceDataFormat
+    quint8 littleEndian;
+    quint8 ok;              // только для CaptureSweepEnd
+    quint8 reserved;
+};
+
+static_assert(sizeof(SessionCaptureHeader) == 32, "capture header layout");
+static_assert(sizeof(CaptureRecordHeader) == 16, "capture record header layout");
+static_assert(sizeof(CaptureSweepMark) % 8 == 0, "capture sweep mark must keep records 8-byte aligned");
+
+inline quint64 captureRecordSize(quint32 payload) { return sizeof(CaptureRecordHeader) + ((quint64(payload) + 7) & ~quint64(7)); }
+
+// Пишется из потока сокета. Данные идут через буфер QFile, поэтому
+// запись мелкой команды не стоит системного вызова.
+class SessionCapture
+{
+public:
+    SessionCapture();
+    ~SessionCapture();
+
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return _file.isOpen(); }
+    QString path() const { return _file.fileName(); }
+    QString errorString() const { return _error; }
+    quint64 bytesWritten() const { return _written; }
+
+    bool write(CaptureRecordKind kind, const char* data, qsizetype size);
+    bool writeSweepMark(CaptureRecordKind kind, quint64 sequence, qint64 wallMs, const ScanParameters& settings,
+                        TraceDataFormat format, bool littleEndian, bool ok = true);
+
+private:
+    QFile _file;
+    QString _error;
+    QElapsedTimer _clock;
+    quint64 _written;
+};
+
+#endif // SESSIONCAPTURE_H
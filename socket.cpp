@@ -1,25 +1,79 @@
 #include "socket.h"
 #include "vnaclient.h"
 #include "vnacomand.h"
+#include "sweeprecorder.h"
+#include "sessioncapture.h"
 #include <QDebug>
+#include <QLoggingCategory>
 #include <QThread>
-#include <QEventLoop>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QDateTime>
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 #define DEFAULT_NORMAL_TIMEOUT_MS 15000
 #define DEFAULT_OPC_TIMEOUT_MS  45000
-#define DEFAULT_FDAT_INTERVAL_MS 2000
+#define DEFAULT_MIN_SWEEP_INTERVAL_MS 50
+#define MAX_JOINED_LINE_BYTES 1024
+
+#define CONNECT_TIMEOUT_MS 5000
+#define RECONNECT_INITIAL_DELAY_MS 250      // удваивается с каждой неудачной попыткой
+#define RECONNECT_MAX_DELAY_MS 10000
+#define HEALTH_CHECK_INTERVAL_MS 5000       // *OPC?, если прибор столько молчит без запросов
+#define HEALTH_CHECK_TIMEOUT_MS 5000
+#define KEEPALIVE_IDLE_S 5
+#define KEEPALIVE_INTERVAL_S 2
+#define KEEPALIVE_PROBES 3
+#define TCP_USER_TIMEOUT_MS 20000           // неподтверждённые данные дольше — связь считается потерянной
+#define RECORDER_RETRY_MS 5                 // кольцо записи полно — когда проверить снова
+#define SEGMENT_MIN_POINTS 101              // меньше — накладные расходы на сегмент дороже выигрыша
+
+// Отладочный вывод потока сокета по умолчанию выключен и не вычисляет
+// аргументы; включается правилом QT_LOGGING_RULES="tair.socket.debug=true".
+Q_LOGGING_CATEGORY(lcSocket, "tair.socket", QtWarningMsg)
 
 Socket::Socket(QObject* parent)
     : VNAclient(parent)
     , _socket(nullptr)
-    , _fdatTimer(nullptr)
+    , _resyncing(false)
+    , _resyncNonce(1)
+    , _opcToken(0)
+    , _replyTimer(nullptr)
+    , _sweepTimer(nullptr)
+    , _connectTimer(nullptr)
+    , _reconnectTimer(nullptr)
+    , _healthTimer(nullptr)
     , _thread(nullptr)
+    , _connecting(false)
+    , _reconnecting(false)
+    , _reconnectAttempts(0)
+    , _lastActivityNs(0)
+    , _healthProbePending(false)
+    , _stateKnown(false)
+    , _verifyConfiguration(false)
     , _scanning(false)
-    , _currentGraphCount(1)
+    , _externalTrigger(false)
+    , _sweepRequested(false)
+    , _sweepState(SweepState::Idle)
+    , _sweepStartedNs(0)
+    , _sweepSequence(0)
+    , _recorder(nullptr)
+    , _backlogRecorder(nullptr)
+    , _capture(nullptr)
+    , _triggerCommand(makeScpi<ScpiId::TriggerSingle>())
+    , _opcCommand(makeScpi<ScpiId::OperationComplete>())
+    , _segmentPoints(0)
+    , _segmentIndex(0)
+    , _segmentsDirty(false)
     , _normalTimeout(DEFAULT_NORMAL_TIMEOUT_MS)
     , _opcTimeout(DEFAULT_OPC_TIMEOUT_MS)
-    , _fdatInterval(DEFAULT_FDAT_INTERVAL_MS)
+    , _minSweepInterval(DEFAULT_MIN_SWEEP_INTERVAL_MS)
+    , _dataFormat(TraceDataFormat::Ascii)
+    , _littleEndian(false)
     , _host(QHostAddress::LocalHost)
     , _port(5025)
 {
@@ -32,6 +86,7 @@ Socket::Socket(QObject* parent)
 Socket::~Socket()
 {
     stopThread();
+    delete _capture;
     if (_thread) {
         delete _thread;
         _thread = nullptr;
@@ -43,14 +98,112 @@ VNAclient* Socket::getInstance()
     return this;
 }
 
-void Socket::setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int fdatIntervalMs)
+void Socket::setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int minSweepIntervalMs)
 {
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, normalTimeoutMs, opcTimeoutMs, minSweepIntervalMs]() {
+            setTimeouts(normalTimeoutMs, opcTimeoutMs, minSweepIntervalMs);
+        }, Qt::QueuedConnection);
+        return;
+    }
     _normalTimeout = normalTimeoutMs;
     _opcTimeout = opcTimeoutMs;
-    _fdatInterval = fdatIntervalMs;
-    if (_fdatTimer) {
-        QMetaObject::invokeMethod(_fdatTimer, "setInterval", Qt::QueuedConnection, Q_ARG(int, _fdatInterval));
+    _minSweepInterval = qMax(0, minSweepIntervalMs);
+}
+
+void Socket::setDataTransferMode(TraceDataFormat format, bool littleEndian)
+{
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, format, littleEndian]() {
+            setDataTransferMode(format, littleEndian);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    if (format == _dataFormat && littleEndian == _littleEndian) return;
+    _dataFormat = format;
+    _littleEndian = littleEndian;
+    // Формат записывается в каждую команду при постановке в очередь: запросы,
+    // ушедшие раньше, разбираются по-старому, новые встают после FORM:*
+    const QVector<ScpiCommand> formatCmds = dataFormatCommands();
+    if (!_scanCommands.isEmpty()) {
+        QVector<ScpiCommand> scan = formatCmds;
+        for (const ScpiCommand& command : _scanCommands) {
+            if (command.id != ScpiId::FormatData && command.id != ScpiId::FormatBorder) scan.append(command);
+        }
+        _scanCommands = scan;
+    }
+    if (_stateKnown) {
+        enqueueConfiguration(formatCmds);
+        flushOutgoing();
+    }
+}
+
+QVector<ScpiCommand> Socket::dataFormatCommands() const
+{
+    QVector<ScpiCommand> cmds;
+    cmds.append(makeScpi<ScpiId::FormatData>(formatDataToken(_dataFormat)));
+    if (_dataFormat != TraceDataFormat::Ascii) {
+        cmds.append(makeScpi<ScpiId::FormatBorder>(byteOrderToken(_littleEndian)));
+    }
+    return cmds;
+}
+
+void Socket::setExternalSweepTrigger(bool external)
+{
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, external]() { setExternalSweepTrigger(external); }, Qt::QueuedConnection);
+        return;
+    }
+    if (external && !_externalTrigger && _scanning && _sweepState == SweepState::Idle) {
+        // свип, который ждёт таймера, становится первым по общему запросу
+        _sweepRequested = true;
+    }
+    _externalTrigger = external;
+    if (!external) scheduleNextSweep();
+}
+
+void Socket::setRecorder(SweepRecorder* recorder)
+{
+    _recorder.store(recorder, std::memory_order_release);
+}
+
+bool Socket::startCapture(const QString& path)
+{
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        bool ok = false;
+        QMetaObject::invokeMethod(this, [this, path, &ok]() { ok = startCapture(path); }, Qt::BlockingQueuedConnection);
+        return ok;
+    }
+    stopCapture();
+    auto* capture = new SessionCapture();
+    if (!capture->open(path)) {
+        qCWarning(lcSocket) << "Cannot capture session to" << path << ":" << capture->errorString();
+        delete capture;
+        return false;
+    }
+    _capture = capture;
+    qCDebug(lcSocket) << "Capturing session to" << path;
+    return true;
+}
+
+void Socket::stopCapture()
+{
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { stopCapture(); }, Qt::BlockingQueuedConnection);
+        return;
     }
+    if (!_capture) return;
+    qCDebug(lcSocket) << "Session capture closed:" << _capture->path() << _capture->bytesWritten() << "bytes";
+    delete _capture;
+    _capture = nullptr;
+}
+
+void Socket::captureSweepMark(bool begin, bool ok)
+{
+    if (!_capture) return;
+    _capture->writeSweepMark(begin ? CaptureSweepBegin : CaptureSweepEnd,
+                             begin ? _sweepSequence + 1 : _sweepSequence,
+                             QDateTime::currentMSecsSinceEpoch(), _scanSettings, _dataFormat, _littleEndian, ok);
 }
 
 void Socket::startThread()
@@ -67,7 +220,7 @@ void Socket::stopThread()
         QMetaObject::invokeMethod(this, "stopInThread", Qt::BlockingQueuedConnection);
         _thread->quit();
         if (!_thread->wait(3000)) {
-            qWarning() << "Socket thread didn't finish in time; terminating.";
+            qCWarning(lcSocket) << "Socket thread didn't finish in time; terminating.";
             _thread->terminate();
             _thread->wait();
         }
@@ -76,31 +229,52 @@ void Socket::stopThread()
 
 void Socket::initializeInThread()
 {
-    qDebug() << "Socket::initializeInThread in thread" << QThread::currentThread();
+    qCDebug(lcSocket) << "Socket::initializeInThread in thread" << QThread::currentThread();
     _socket = new QTcpSocket(this);
     connect(_socket, &QTcpSocket::connected, this, &Socket::onConnected);
     connect(_socket, &QTcpSocket::disconnected, this, &Socket::onDisconnected);
+    connect(_socket, &QTcpSocket::readyRead, this, &Socket::onReadyRead);
     connect(_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::errorOccurred),
             this, [this](QAbstractSocket::SocketError err){
+                if (_connecting) {
+                    connectionLost(err, _socket->errorString());
+                    return;
+                }
                 if (!_scanning) return;
-                qWarning() << "Socket error:" << err << _socket->errorString();
+                qCWarning(lcSocket) << "Socket error:" << err << _socket->errorString();
                 emit error(err, _socket->errorString());
             });
-    _fdatTimer = new QTimer(this);
-    _fdatTimer->setInterval(_fdatInterval);
-    _fdatTimer->setSingleShot(false);
-    connect(_fdatTimer, &QTimer::timeout, this, &Socket::requestFDAT);
-    qDebug() << "Socket initialized (thread): timeouts normal=" << _normalTimeout
-             << " opc=" << _opcTimeout << " fdatInterval=" << _fdatInterval;
+    _replyTimer = new QTimer(this);
+    _replyTimer->setSingleShot(true);
+    connect(_replyTimer, &QTimer::timeout, this, &Socket::onReplyTimeout);
+    _clock.start();
+    _sweepTimer = new QTimer(this);
+    _sweepTimer->setSingleShot(true);
+    connect(_sweepTimer, &QTimer::timeout, this, &Socket::startSweep);
+    _connectTimer = new QTimer(this);
+    _connectTimer->setSingleShot(true);
+    connect(_connectTimer, &QTimer::timeout, this, &Socket::onConnectTimeout);
+    _reconnectTimer = new QTimer(this);
+    _reconnectTimer->setSingleShot(true);
+    connect(_reconnectTimer, &QTimer::timeout, this, &Socket::reconnect);
+    _healthTimer = new QTimer(this);
+    connect(_healthTimer, &QTimer::timeout, this, &Socket::onHealthCheck);
+    qCDebug(lcSocket) << "Socket initialized (thread): timeouts normal=" << _normalTimeout
+                      << " opc=" << _opcTimeout << " minSweepInterval=" << _minSweepInterval;
 }
 
 void Socket::cleanupInThread()
 {
-    qDebug() << "Socket::cleanupInThread in thread" << QThread::currentThread();
-    if (_fdatTimer) {
-        if (_fdatTimer->isActive()) _fdatTimer->stop();
-        _fdatTimer = nullptr;
+    qCDebug(lcSocket) << "Socket::cleanupInThread in thread" << QThread::currentThread();
+    if (_sweepTimer) {
+        if (_sweepTimer->isActive()) _sweepTimer->stop();
+        _sweepTimer = nullptr;
     }
+    _connectTimer = nullptr;
+    _reconnectTimer = nullptr;
+    _healthTimer = nullptr;
+    cancelPending();
+    _replyTimer = nullptr;
     if (_socket) {
         if (_socket->state() != QAbstractSocket::UnconnectedState) {
             _socket->disconnectFromHost();
@@ -110,14 +284,20 @@ void Socket::cleanupInThread()
         }
         _socket = nullptr;
     }
-    qDebug() << "Socket cleanup finished (cleanupInThread)";
+    qCDebug(lcSocket) << "Socket cleanup finished (cleanupInThread)";
 }
 void Socket::stopInThread()
 {
-    qDebug() << "Socket::stopInThread() executing in thread" << QThread::currentThread();
-    if (_fdatTimer) {
-        if (_fdatTimer->isActive()) _fdatTimer->stop();
+    qCDebug(lcSocket) << "Socket::stopInThread() executing in thread" << QThread::currentThread();
+    _scanning = false;
+    _reconnecting = false;
+    _connecting = false;
+    if (_sweepTimer) {
+        if (_sweepTimer->isActive()) _sweepTimer->stop();
     }
+    if (_connectTimer) _connectTimer->stop();
+    if (_reconnectTimer) _reconnectTimer->stop();
+    if (_healthTimer) _healthTimer->stop();
     if (_socket) {
         if (_socket->state() != QAbstractSocket::UnconnectedState) {
             _socket->disconnectFromHost();
@@ -126,142 +306,550 @@ void Socket::stopInThread()
             }
         }
     }
+    cancelPending();
     _scanning = false;
-    qDebug() << "Socket::stopInThread completed";
+    qCDebug(lcSocket) << "Socket::stopInThread completed";
 }
 
 bool Socket::ensureConnection(const QHostAddress& host, quint16 port)
 {
     if (!_socket) {
-        qWarning() << "Socket not initialized (ensureConnection)";
+        qCWarning(lcSocket) << "Socket not initialized (ensureConnection)";
         return false;
     }
-    if (_socket->state() == QAbstractSocket::ConnectedState && _host == host && _port == port) {
+    const bool sameTarget = _host == host && _port == port;
+    if (sameTarget && (_connecting || _socket->state() == QAbstractSocket::ConnectedState)) {
+        // команды ждут в _outgoing, пока не придёт connected
         return true;
     }
-    if (_socket->state() == QAbstractSocket::ConnectedState) {
-        _socket->disconnectFromHost();
+    if (!sameTarget) {
         if (_socket->state() != QAbstractSocket::UnconnectedState) {
-            _socket->waitForDisconnected(1000);
+            // другой прибор: прежнюю связь не восстанавливать
+            const bool scanning = _scanning;
+            _scanning = false;
+            _connecting = false;
+            _socket->abort();
+            _scanning = scanning;
         }
+        _reconnecting = false;
+        _reconnectAttempts = 0;
     }
-    qDebug() << "Connecting to" << host.toString() << port;
-    _socket->connectToHost(host, port);
-    if (!_socket->waitForConnected(_normalTimeout)) {
-        qWarning() << "Failed to connect within" << _normalTimeout << "ms. err:" << _socket->errorString();
-        emit error(_socket->error(), _socket->errorString());
-        return false;
-    }
+    if (_reconnectTimer) _reconnectTimer->stop();
+    cancelPending();
     _host = host;
     _port = port;
-    QThread::msleep(50);
-    qDebug() << "Connected to" << _host.toString() << ":" << _port;
+    startConnecting();
     return true;
 }
 
-bool Socket::waitForOperationsComplete(int timeoutMs)
+void Socket::startConnecting()
 {
-    if (!_socket || _socket->state() != QAbstractSocket::ConnectedState) {
-        qWarning() << "No socket or not connected for OPC";
-        return false;
+    // другой прибор или он мог перезагрузиться — настройки неизвестны
+    _stateKnown = false;
+    _instrumentState.clear();
+    qCDebug(lcSocket) << "Connecting to" << _host.toString() << _port << "attempt" << _reconnectAttempts + 1;
+    _connecting = true;
+    _socket->connectToHost(_host, _port);
+    if (_connecting && _connectTimer) _connectTimer->start(CONNECT_TIMEOUT_MS);
+}
+
+void Socket::configureSocketOptions()
+{
+    _socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    _socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+#ifdef Q_OS_LINUX
+    // по умолчанию keepalive срабатывает через 2 часа простоя, а повторная
+    // передача неподтверждённых данных длится минутами
+    const int fd = int(_socket->socketDescriptor());
+    if (fd < 0) return;
+    const int idle = KEEPALIVE_IDLE_S;
+    const int interval = KEEPALIVE_INTERVAL_S;
+    const int probes = KEEPALIVE_PROBES;
+    const unsigned int userTimeout = TCP_USER_TIMEOUT_MS;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes)) != 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout)) != 0) {
+        qCWarning(lcSocket) << "Cannot tune TCP keepalive for" << _host.toString();
+    }
+#endif
+}
+
+void Socket::onConnectTimeout()
+{
+    if (!_connecting) return;
+    _connecting = false;
+    _socket->abort();
+    connectionLost(QAbstractSocket::SocketTimeoutError,
+                   QString("Connection to %1:%2 timed out").arg(_host.toString()).arg(_port));
+}
+
+void Socket::connectionLost(int code, const QString& reason)
+{
+    _connecting = false;
+    if (_connectTimer) _connectTimer->stop();
+    if (_healthTimer) _healthTimer->stop();
+    if (_sweepTimer) _sweepTimer->stop();
+    _healthProbePending = false;
+    // флаг ставится до cancelPending: обработчики отменённых команд
+    // не должны запускать следующий свип
+    if (_scanning) _reconnecting = true;
+    cancelPending();
+    _sweepState = SweepState::Idle;
+    _frame.reset();
+    if (!reason.isEmpty() && _reconnectAttempts == 0) {
+        // о повторных неудачах не сообщаем — переподключение идёт в фоне
+        qCWarning(lcSocket) << "Connection to" << _host.toString() << _port << "failed:" << reason;
+        emit error(code, reason);
     }
-    _socket->readAll();
-    qDebug() << "Sending *OPC? and waiting up to" << timeoutMs << "ms";
-    _socket->write("*OPC?\n");
-    _socket->flush();
-    QEventLoop loop;
-    QTimer timer;
-    timer.setSingleShot(true);
-    connect(_socket, &QTcpSocket::readyRead, &loop, &QEventLoop::quit);
-    connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-    timer.start(timeoutMs);
-    loop.exec();
-    if (!timer.isActive()) {
-        qWarning() << "OPC wait timeout";
+    if (!_scanning || !_reconnectTimer) return;
+    const int delay = qMin(RECONNECT_MAX_DELAY_MS, RECONNECT_INITIAL_DELAY_MS << qMin(_reconnectAttempts, 6));
+    ++_reconnectAttempts;
+    qCWarning(lcSocket) << "Reconnecting to" << _host.toString() << _port << "in" << delay << "ms, attempt" << _reconnectAttempts;
+    _reconnectTimer->start(delay);
+}
+
+void Socket::reconnect()
+{
+    if (!_scanning || !_socket || _connecting || _socket->state() != QAbstractSocket::UnconnectedState) return;
+    _metrics.add(SocketMetrics::ReconnectAttempts);
+    startConnecting();
+}
+
+void Socket::resumeScan()
+{
+    qCWarning(lcSocket) << "Connection to" << _host.toString() << _port << "restored, re-applying configuration";
+    _frequencyKHz.clear();
+    _lastTraces.clear();
+    applyScanConfiguration();
+    requestOperationComplete(_opcTimeout, [this](bool ok) {
+        if (!_socket || _socket->state() != QAbstractSocket::ConnectedState) return;
+        if (!ok) {
+            qCWarning(lcSocket) << "resumeScan: OPC timeout/failed; resuming sweeps anyway";
+        }
+        _reconnecting = false;
+        scheduleNextSweep();
+    });
+}
+
+void Socket::onHealthCheck()
+{
+    if (!_socket || _socket->state() != QAbstractSocket::ConnectedState || _healthProbePending) return;
+    // пока ждём ответов, проверкой служат их таймауты
+    if (!_outgoing.isEmpty() || !_awaiting.isEmpty()) return;
+    if ((_clock.nsecsElapsed() - _lastActivityNs) / 1000000 < HEALTH_CHECK_INTERVAL_MS) return;
+    _healthProbePending = true;
+    enqueue(_opcCommand, [this](bool ok, const QByteArray&) {
+        _healthProbePending = false;
+        if (ok || !_socket || _socket->state() != QAbstractSocket::ConnectedState) return;
+        _metrics.add(SocketMetrics::HealthChecksFailed);
+        qCWarning(lcSocket) << "Instrument" << _host.toString() << "does not answer; dropping connection";
+        // разрыв — после выхода из обработчика таймаута
+        QMetaObject::invokeMethod(this, [this]() {
+            if (_socket) _socket->abort();
+        }, Qt::QueuedConnection);
+    }, HEALTH_CHECK_TIMEOUT_MS);
+    flushOutgoing();
+}
+
+quint64 Socket::requestOperationComplete(int timeoutMs, OpcContinuation continuation)
+{
+    const quint64 token = ++_opcToken;
+    qCDebug(lcSocket) << "Queue *OPC? token" << token << "timeout" << timeoutMs << "ms";
+    const qint64 queuedNs = _clock.nsecsElapsed();
+    enqueue(_opcCommand, [this, token, continuation, queuedNs](bool replied, const QByteArray& reply) {
+        const bool ok = replied && parseReply<ScpiId::OperationComplete>(reply) == 1.0;
+        _metrics.record(SocketMetrics::OpcWait, (_clock.nsecsElapsed() - queuedNs) / 1000);
+        if (!ok) {
+            qCWarning(lcSocket) << "OPC token" << token << "failed or timed out";
+        }
+        if (continuation) continuation(ok);
+        emit operationComplete(token, ok);
+    }, timeoutMs);
+    flushOutgoing();
+    return token;
+}
+
+bool Socket::rememberSetting(const ScpiCommand& command)
+{
+    auto it = _instrumentState.constFind(command.header);
+    if (it != _instrumentState.constEnd() && it->scpi == command.scpi) {
         return false;
     }
-    QByteArray resp = _socket->readAll().trimmed();
-    qDebug() << "OPC response raw:" << resp;
-    return (resp == "1" || resp == "1\r" || resp == "1\n");
+    if (command.id == ScpiId::ParameterCount) {
+        // при смене числа трасс прибор мог сбросить их определения
+        for (auto s = _instrumentState.begin(); s != _instrumentState.end();) {
+            if (s->trace > 0) s = _instrumentState.erase(s);
+            else ++s;
+        }
+    }
+    InstrumentSetting setting;
+    setting.scpi = command.scpi;
+    setting.trace = command.trace;
+    _instrumentState.insert(command.header, setting);
+    return true;
 }
 
-void Socket::sendCommandWithOPC(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands)
+void Socket::enqueueConfiguration(const QVector<ScpiCommand>& commands)
 {
-    if (!ensureConnection(host, port)) {
-        qDeleteAll(commands);
-        return;
+    // Уходят только изменившиеся настройки; выбор и показ трассы — только
+    // для трасс, у которых что-то изменилось. Прочие команды — всегда.
+    QVector<bool> changed(commands.size(), false);
+    QVector<int> touchedTraces;
+    for (int i = 0; i < commands.size(); ++i) {
+        const ScpiCommand& command = commands[i];
+        if (!command.isSetting() || !rememberSetting(command)) continue;
+        changed[i] = true;
+        if (command.trace > 0 && !touchedTraces.contains(command.trace)) touchedTraces.append(command.trace);
     }
-    for (auto *cmd : commands) {
-        QByteArray ba = cmd->SCPI.toUtf8();
-        qDebug() << "sendCommandWithOPC: write:" << ba.trimmed();
-        _socket->write(ba);
-        _socket->flush();
-        if (cmd->request) {
-            if (!_socket->waitForReadyRead(_normalTimeout)) {
-                qWarning() << "Timeout waiting reply for" << ba.trimmed();
-                emit error(-1, QString("Timeout for command: %1").arg(QString::fromUtf8(ba)));
-                delete cmd;
-                continue;
-            }
-            QByteArray reply = _socket->readAll();
-            emit dataFromVNA(QString::fromUtf8(reply), cmd);
+    for (int i = 0; i < commands.size(); ++i) {
+        const ScpiCommand& command = commands[i];
+        const bool send = command.isSetting() ? changed[i] : command.trace <= 0 || touchedTraces.contains(command.trace);
+        if (send) {
+            enqueue(command);
         } else {
-            delete cmd;
+            _metrics.add(SocketMetrics::SettingsSkipped);
         }
     }
-    if (!waitForOperationsComplete(_opcTimeout)) {
-        qWarning() << "OPC did not complete within" << _opcTimeout << "ms";
+}
+
+void Socket::applyScanConfiguration()
+{
+    if (!_stateKnown) {
+        // состояние прибора неизвестно (новое соединение): сброс и полная настройка,
+        // сброс удаляет и трассы — их настройка повторяется следом
+        qCDebug(lcSocket) << "Instrument state unknown, full configuration after preset";
+        enqueue(makeScpi<ScpiId::SystemPreset>());
+        _instrumentState.clear();
+        _stateKnown = true;
+        enqueueConfiguration(_scanCommands);
+        enqueueConfiguration(_setupCommands);
+    } else {
+        enqueueConfiguration(_scanCommands);
+    }
+    if (_verifyConfiguration) enqueueVerification();
+}
+
+static bool settingMatches(const QByteArray& command, const QByteArray& reply)
+{
+    const int space = command.indexOf(' ');
+    if (space < 0) return true;
+    QByteArray expected = command.mid(space + 1).trimmed().toUpper();
+    QByteArray actual = reply.trimmed().toUpper();
+    if (actual.size() >= 2 && (actual.startsWith('"') || actual.startsWith('\''))) {
+        actual = actual.mid(1, actual.size() - 2);
+    }
+    for (QByteArray* value : {&expected, &actual}) {
+        if (*value == "ON") *value = "1";
+        else if (*value == "OFF") *value = "0";
+    }
+    bool expectedNumeric = false;
+    bool actualNumeric = false;
+    const double expectedValue = expected.toDouble(&expectedNumeric);
+    const double actualValue = actual.toDouble(&actualNumeric);
+    if (expectedNumeric && actualNumeric) {
+        return qAbs(expectedValue - actualValue) <= 1e-6 * qMax(1.0, qAbs(expectedValue));
+    }
+    // прибор отвечает короткой формой, а команда могла уйти в длинной, и наоборот
+    return !actual.isEmpty() && (expected.startsWith(actual) || actual.startsWith(expected));
+}
+
+void Socket::enqueueVerification()
+{
+    for (auto it = _instrumentState.constBegin(); it != _instrumentState.constEnd(); ++it) {
+        const QByteArray expected = it->scpi;
+        const ScpiCommand query = ScpiCommand::raw(it.key() + '?', ReplyKind::Text);
+        enqueue(query, [this, expected](bool ok, const QByteArray& reply) {
+            if (!ok) return;
+            const QByteArray actual = ScpiReplyParser<ReplyKind::Text>::parse(reply, TraceDataFormat::Ascii, false);
+            if (settingMatches(expected, actual)) return;
+            _metrics.add(SocketMetrics::SettingMismatches);
+            qCWarning(lcSocket) << "Instrument setting differs from cache:" << actual << "instead of" << expected << "- resending";
+            // поправка уходит раньше следующего TRIG:SING
+            enqueue(ScpiCommand::raw(expected));
+            flushOutgoing();
+        });
     }
 }
 
-void Socket::sendCommand(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands)
+void Socket::setVerifyConfiguration(bool verify)
+{
+    if (_thread && _thread->isRunning() && QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, verify]() { setVerifyConfiguration(verify); }, Qt::QueuedConnection);
+        return;
+    }
+    _verifyConfiguration = verify;
+}
+
+void Socket::sendCommand(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands)
 {
     if (QThread::currentThread() != _thread) {
-        QVector<VNAcomand*> *copy = new QVector<VNAcomand*>();
-        copy->reserve(commands.size());
-        for (auto *c : commands) {
-            copy->append(new VNAcomand(c->request, c->type, c->SCPI));
-        }
-        QMetaObject::invokeMethod(this, "sendCommand", Qt::QueuedConnection,
-                                  Q_ARG(QHostAddress, host),
-                                  Q_ARG(quint16, port),
-                                  Q_ARG(QVector<VNAcomand*>, *copy));
-        qDeleteAll(*copy);
-        delete copy;
+        QMetaObject::invokeMethod(this, [this, host, port, commands]() {
+            sendCommandImpl(host, port, commands);
+        }, Qt::QueuedConnection);
         return;
     }
     sendCommandImpl(host, port, commands);
 }
 
-void Socket::sendCommandImpl(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands)
+void Socket::sendCommandImpl(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands)
 {
     if (!ensureConnection(host, port)) {
-        qDeleteAll(commands);
         return;
     }
-    for (auto *cmd : commands) {
-        QByteArray ba = cmd->SCPI.toUtf8();
-        qDebug() << "sendCommandImpl: sending" << ba.trimmed();
-        _socket->write(ba);
-        _socket->flush();
-        if (!cmd->request) {
-            delete cmd;
+    for (const ScpiCommand& command : commands) {
+        // явно отправленная настройка тоже попадает в модель состояния прибора
+        if (command.isSetting()) rememberSetting(command);
+        enqueue(command);
+    }
+    flushOutgoing();
+}
+
+int Socket::replyTimeoutFor(const ScpiCommand& command) const
+{
+    if (command.header.contains("FDAT") || command.header.contains("XAXIS")) {
+        return qMax(_normalTimeout, 30000);
+    }
+    return _normalTimeout;
+}
+
+void Socket::enqueue(const ScpiCommand& command, ReplyHandler onReply, int timeoutMs)
+{
+    PendingCommand pending;
+    if (command.isNull()) return;
+    pending.command = command;
+    pending.command.dataFormat = _dataFormat;
+    pending.command.littleEndian = _littleEndian;
+    pending.onReply = std::move(onReply);
+    pending.timeoutMs = timeoutMs > 0 ? timeoutMs : replyTimeoutFor(command);
+    _outgoing.enqueue(pending);
+}
+
+
+void Socket::enqueueBarrier(ReplyHandler onReached)
+{
+    PendingCommand pending;
+    pending.onReply = std::move(onReached);
+    _outgoing.enqueue(pending);
+}
+
+void Socket::flushOutgoing()
+{
+    if (_outgoing.isEmpty() || _resyncing) return;
+    if (!_socket || _socket->state() != QAbstractSocket::ConnectedState) {
+        if (_connecting) return;    // уйдут из onConnected
+        qCWarning(lcSocket) << "flushOutgoing: not connected, dropping" << _outgoing.size() << "commands";
+        cancelPending();
+        return;
+    }
+
+    // Команды без ответа склеиваются в одну строку через ';', каждый запрос
+    // идёт отдельной строкой, чтобы ответы приходили по одному на строку.
+    _writeBuffer.resize(0);
+    qsizetype lineStart = -1;
+    const qint64 now = _clock.nsecsElapsed();
+    while (!_outgoing.isEmpty()) {
+        PendingCommand pending = _outgoing.dequeue();
+        if (pending.command.isNull()) {
+            _awaiting.enqueue(pending);
             continue;
         }
-        int timeout = _normalTimeout;
-        if (cmd->SCPI.contains("FDAT") || cmd->SCPI.contains("XAXIS")) {
-            timeout = qMax(timeout, 30000);
-        }
-        if (!_socket->waitForReadyRead(timeout)) {
-            qWarning() << "Timeout waiting response to" << ba.trimmed() << "timeout(ms)=" << timeout;
-            emit error(-1, QString("Timeout waiting response for %1").arg(QString::fromUtf8(ba)));
-            delete cmd;
+        const QByteArray& scpi = pending.command.scpi;
+
+        if (pending.command.isQuery()) {
+            if (lineStart >= 0) {
+                _writeBuffer.append('\n');
+                lineStart = -1;
+            }
+            qCDebug(lcSocket) << "flushOutgoing: query" << scpi;
+            _writeBuffer.append(scpi);
+            _writeBuffer.append('\n');
+            _metrics.add(SocketMetrics::CommandsSent);
+            pending.sentNs = now;
+            _awaiting.enqueue(pending);
             continue;
         }
-        QByteArray resp = _socket->readAll();
-        qDebug() << "sendCommandImpl: received" << resp.size() << "bytes for" << ba.trimmed();
-        emit dataFromVNA(QString::fromUtf8(resp), cmd);
+
+        if (lineStart >= 0 && _writeBuffer.size() - lineStart + scpi.size() < MAX_JOINED_LINE_BYTES) {
+            _writeBuffer.append(';');
+            if (!scpi.startsWith('*') && !scpi.startsWith(':'))
+                _writeBuffer.append(':');
+        } else {
+            if (lineStart >= 0)
+                _writeBuffer.append('\n');
+            lineStart = _writeBuffer.size();
+        }
+        qCDebug(lcSocket) << "flushOutgoing: command" << scpi;
+        _writeBuffer.append(scpi);
+        _metrics.add(SocketMetrics::CommandsSent);
+        if (pending.onReply) {
+            _awaiting.enqueue(pending);
+        }
     }
+    if (lineStart >= 0)
+        _writeBuffer.append('\n');
+
+    if (!_writeBuffer.isEmpty()) {
+        _metrics.add(SocketMetrics::BytesSent, quint64(_writeBuffer.size()));
+        if (_capture) _capture->write(CaptureTx, _writeBuffer.constData(), _writeBuffer.size());
+        _socket->write(_writeBuffer);
+        _socket->flush();
+    }
+    runReachedBarriers();
+    armReplyTimer();
+}
+
+void Socket::onReadyRead()
+{
+    const qint64 got = _framer.readFrom(_socket);
+    _lastActivityNs = _clock.nsecsElapsed();
+    if (_capture && got > 0) _capture->write(CaptureRx, _framer.tail(got), got);
+    QByteArray reply;
+    while (_framer.takeReply(reply)) {
+        dispatchReply(reply);
+    }
+}
+
+void Socket::dispatchReply(const QByteArray& reply)
+{
+    bool echoed = false;
+    if (_resyncing && (reply.trimmed().toInt(&echoed) != _resyncNonce || !echoed)) {
+        // ответ на запрос, отменённый при пересинхронизации
+        _metrics.add(SocketMetrics::StaleReplies);
+        qCWarning(lcSocket) << "Dropping late reply of" << reply.size() << "bytes";
+        return;
+    }
+    if (_awaiting.isEmpty() || _awaiting.head().command.isNull()) {
+        qCWarning(lcSocket) << "Unexpected reply of" << reply.size() << "bytes";
+        return;
+    }
+    PendingCommand pending = _awaiting.dequeue();
+    // пока идёт пересинхронизация, в _awaiting только контрольный запрос
+    const bool resynced = _resyncing;
+    _resyncing = false;
+    _metrics.add(SocketMetrics::RepliesReceived);
+    _metrics.add(SocketMetrics::BytesReceived, quint64(reply.size()));
+    _metrics.recordCommand(pending.command.header, (_clock.nsecsElapsed() - pending.sentNs) / 1000);
+    if (pending.cancelled) {
+        // ответ на отменённый запрос не нужен
+    } else if (pending.onReply) {
+        pending.onReply(true, reply);
+    } else {
+        qCDebug(lcSocket) << "Received" << reply.size() << "bytes for" << pending.command.header;
+        emit dataFromVNA(reply, pending.command);
+    }
+    runReachedBarriers();
+    armReplyTimer();
+    if (resynced) {
+        qCDebug(lcSocket) << "Reply stream resynchronized";
+        flushOutgoing();
+    }
+}
+
+void Socket::runReachedBarriers()
+{
+    while (!_awaiting.isEmpty() && _awaiting.head().command.isNull()) {
+        PendingCommand barrier = _awaiting.dequeue();
+        if (barrier.onReply) barrier.onReply(!barrier.cancelled, QByteArray());
+    }
+}
+
+void Socket::armReplyTimer()
+{
+    if (!_replyTimer) return;
+    if (_awaiting.isEmpty()) {
+        _replyTimer->stop();
+        return;
+    }
+    const PendingCommand& head = _awaiting.head();
+    const qint64 elapsedMs = (_clock.nsecsElapsed() - head.sentNs) / 1000000;
+    _replyTimer->start(int(qMax<qint64>(0, head.timeoutMs - elapsedMs)));
+}
+
+void Socket::onReplyTimeout()
+{
+    if (_awaiting.isEmpty() || _awaiting.head().command.isNull()) return;
+    const PendingCommand& pending = _awaiting.head();
+    _metrics.add(SocketMetrics::ReplyTimeouts);
+    qCWarning(lcSocket) << "Timeout waiting response to" << pending.command.header << "timeout(ms)=" << pending.timeoutMs;
+    if (_resyncing) {
+        // не ответил и контрольный запрос — соединение пересоздаётся через onDisconnected
+        qCWarning(lcSocket) << "Instrument" << _host.toString() << "does not answer; dropping connection";
+        if (_replyTimer) _replyTimer->stop();
+        QMetaObject::invokeMethod(this, [this]() {
+            if (_socket) _socket->abort();
+        }, Qt::QueuedConnection);
+        return;
+    }
+    if (!pending.cancelled) {
+        emit error(-1, QString("Timeout waiting response for %1").arg(QString::fromUtf8(pending.command.header)));
+    }
+    resynchronize();
+}
+
+void Socket::resynchronize()
+{
+    // Ответы сопоставляются с запросами по порядку, и после пропавшего ответа
+    // каждый следующий достался бы чужому запросу. Всё ожидающее отменяется,
+    // вход отбрасывается до эха числа, записанного в *ESE: запоздавший ответ
+    // другого запроса с ним не совпадёт. Затем очередь идёт дальше.
+    _metrics.add(SocketMetrics::Resyncs);
+    qCWarning(lcSocket) << "Reply stream lost sync, discarding" << _awaiting.size() << "pending replies";
+    QVector<ReplyHandler> handlers;
+    for (QQueue<PendingCommand>* queue : {&_awaiting, &_outgoing}) {
+        for (const PendingCommand& pending : *queue) {
+            if (pending.onReply && !pending.cancelled) handlers.append(pending.onReply);
+        }
+        queue->clear();
+    }
+    // недочитанный двоичный блок framer дочитает по длине из заголовка и
+    // отбросит целиком — после clear() его хвост разобрался бы как строки
+    _resyncing = true;
+    _resyncNonce = _resyncNonce % 254 + 2;
+
+    PendingCommand sentinel;
+    sentinel.command = makeScpi<ScpiId::StatusEnableEcho>(_resyncNonce);
+    sentinel.timeoutMs = _normalTimeout;
+    sentinel.sentNs = _clock.nsecsElapsed();
+    sentinel.onReply = [](bool, const QByteArray&) {};     // конец — в dispatchReply
+    _awaiting.enqueue(sentinel);
+    if (_socket && _socket->state() == QAbstractSocket::ConnectedState) {
+        _socket->write(sentinel.command.scpi + '\n');
+        _metrics.add(SocketMetrics::CommandsSent);
+    }
+    armReplyTimer();
+    // обработчики могут ставить новые команды — они ждут конца пересинхронизации
+    for (const ReplyHandler& handler : handlers) handler(false, QByteArray());
+}
+
+void Socket::cancelPending()
+{
+    QVector<ReplyHandler> handlers;
+    while (!_outgoing.isEmpty()) {
+        PendingCommand pending = _outgoing.dequeue();
+        if (pending.onReply) handlers.append(pending.onReply);
+    }
+    const bool connected = _socket && _socket->state() == QAbstractSocket::ConnectedState;
+    for (PendingCommand& pending : _awaiting) {
+        if (pending.cancelled) continue;
+        pending.cancelled = true;
+        if (pending.onReply) handlers.append(pending.onReply);
+        pending.onReply = ReplyHandler();
+    }
+    if (!connected) {
+        // ответов уже не будет — очередь ожидания больше не нужна
+        _awaiting.clear();
+        _framer.clear();
+        _resyncing = false;
+        if (_replyTimer) _replyTimer->stop();
+    }
+    for (const ReplyHandler& handler : handlers) handler(false, QByteArray());
+}
+
+void Socket::logCommandStats() const
+{
+    if (!lcSocket().isDebugEnabled()) return;
+    qCDebug(lcSocket).noquote() << _metrics.toJson();
 }
 
 void Socket::startScan(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz)
@@ -279,8 +867,8 @@ void Socket::startScan(const QString& ip, quint16 port, int startKHz, int stopKH
         return;
     }
 
-    qDebug() << "startScan in socket thread, ip:" << ip << "port:" << port
-             << "power:" << powerDbM << "dBm, power freq:" << powerFreqKHz << "kHz";
+    qCDebug(lcSocket) << "startScan in socket thread, ip:" << ip << "port:" << port
+                      << "power:" << powerDbM << "dBm, power freq:" << powerFreqKHz << "kHz";
 
     QHostAddress hostAddr;
     if (!hostAddr.setAddress(ip)) {
@@ -288,33 +876,49 @@ void Socket::startScan(const QString& ip, quint16 port, int startKHz, int stopKH
         return;
     }
 
-    _host = hostAddr;
-    _port = port;
+    _scanSettings.startKHz = startKHz;
+    _scanSettings.stopKHz = stopKHz;
+    _scanSettings.points = points;
+    _scanSettings.band = band;
+    _scanSettings.powerDbM = powerDbM;
+    _scanSettings.powerFreqKHz = powerFreqKHz;
 
     qint64 startHz = qint64(startKHz) * 1000LL;
     qint64 stopHz  = qint64(stopKHz)  * 1000LL;
     qint64 bwHz    = qint64(band);
     qint64 powerFreqHz = qint64(powerFreqKHz) * 1000LL;
 
-    QVector<VNAcomand*> cmds;
-    cmds.append(new SYSTEM_PRESET());
-    cmds.append(new SOURCE_POWER_LEVEL(1, powerDbM));
-    cmds.append(new SENS_FREQ_START(1, startHz));
-    cmds.append(new SENS_FREQ_STOP(1, stopHz));
-    cmds.append(new SENS_FREQ_FIXED(1, powerFreqHz));
-    cmds.append(new SENS_SWE_POINT(1, points));
-    cmds.append(new SENS_BWID(1, bwHz));
-    cmds.append(new TRIGGER_SOURCE_BUS());
-    cmds.append(new INITIATE_CONTINUOUS(1));
-
-    sendCommandWithOPC(_host, _port, cmds);
+    QVector<ScpiCommand> cmds = dataFormatCommands();
+    cmds.append(makeScpi<ScpiId::SourcePowerLevel>(1, powerDbM));
+    cmds.append(makeScpi<ScpiId::FreqStart>(startHz));
+    cmds.append(makeScpi<ScpiId::FreqStop>(stopHz));
+    cmds.append(makeScpi<ScpiId::FreqFixed>(powerFreqHz));
+    cmds.append(makeScpi<ScpiId::SweepPoints>(points));
+    cmds.append(makeScpi<ScpiId::Bandwidth>(bwHz));
+    cmds.append(makeScpi<ScpiId::TriggerSourceBus>());
+    cmds.append(makeScpi<ScpiId::InitContinuous>(1, true));
+    _scanCommands = cmds;
+    _frequencyKHz.clear();
+    _lastTraces.clear();
+    // идущий свип дочитывается по прежнему делению
+    _segmentsDirty = true;
+    if (_sweepState == SweepState::Idle) applySegmentation();
 
-    if (!_scanning) {
-        _scanning = true;
-        if (_fdatTimer) _fdatTimer->start();
+    const bool wasScanning = _scanning;
+    _scanning = true;
+    _reconnecting = false;
+    _reconnectAttempts = 0;
+    if (_reconnectTimer) _reconnectTimer->stop();
+    if (!ensureConnection(hostAddr, port)) {
+        _scanning = wasScanning;
+        return;
     }
-
-    qDebug() << "startScan configured with power" << powerDbM << "dBm and fixed frequency" << powerFreqKHz << "kHz";
+    applyScanConfiguration();
+    requestOperationComplete(_opcTimeout, [this, powerDbM, powerFreqKHz](bool ok) {
+        qCDebug(lcSocket) << "startScan configured with power" << powerDbM << "dBm and fixed frequency"
+                          << powerFreqKHz << "kHz, OPC ok:" << ok;
+        scheduleNextSweep();
+    });
 }
 
 void Socket::stopScan()
@@ -323,91 +927,437 @@ void Socket::stopScan()
         QMetaObject::invokeMethod(this, "stopScan", Qt::QueuedConnection);
         return;
     }
-    qDebug() << "stopScan called";
+    qCDebug(lcSocket) << "stopScan called";
     if (!_scanning) {
-        qDebug() << "Already stopped";
+        qCDebug(lcSocket) << "Already stopped";
         return;
     }
     _scanning = false;
-    if (_fdatTimer && _fdatTimer->isActive()) {
-        _fdatTimer->stop();
+    _sweepRequested = false;
+    _reconnecting = false;
+    _reconnectAttempts = 0;
+    if (_sweepTimer && _sweepTimer->isActive()) {
+        _sweepTimer->stop();
+    }
+    if (_reconnectTimer) _reconnectTimer->stop();
+    cancelPending();
+    // последний свип успеет в запись, если поток записи уже освободил место
+    if (_recordBacklog) flushRecordBacklog();
+    if (_socket && _socket->state() == QAbstractSocket::ConnectedState) {
+        QVector<ScpiCommand> cmds;
+        cmds.append(makeScpi<ScpiId::Abort>());
+        cmds.append(makeScpi<ScpiId::InitContinuous>(1, false));
+        sendCommandImpl(_host, _port, cmds);
+    } else if (_connecting) {
+        // прибор так и не ответил — останавливать на нём нечего
+        _connecting = false;
+        if (_connectTimer) _connectTimer->stop();
+        _socket->abort();
     }
-    QVector<VNAcomand*> cmds;
-    cmds.append(new ABORT_COMMAND());
-    cmds.append(new INITIATE_SINGLE_SHOT(1));
-    sendCommandImpl(_host, _port, cmds);
-    qDebug() << "stopScan completed";
+    logCommandStats();
+    qCDebug(lcSocket) << "stopScan completed";
 }
 
-void Socket::requestFDAT()
+void Socket::startSweep()
 {
-    if (QThread::currentThread() != _thread) {
-        QMetaObject::invokeMethod(this, "requestFDAT", Qt::QueuedConnection);
+    if (!_scanning || _reconnecting) {
         return;
     }
-    if (!_scanning || _activeTraceNumbers.isEmpty()) {
+    if (_sweepState != SweepState::Idle) {
+        _metrics.add(SocketMetrics::SweepsSkippedBusy);
         return;
     }
-    static bool busy = false;
-    if (busy) {
-        qDebug() << "requestFDAT: still busy, skip";
+    if (_externalTrigger && !_sweepRequested) {
         return;
     }
-    busy = true;
-    qDebug() << "requestFDAT: begin";
-    _socket->write("TRIGger:SEQuence:SINGle\n");
-    _socket->flush();
-    bool opcOk = waitForOperationsComplete(_opcTimeout);
-    if (!opcOk) {
-        qWarning() << "requestFDAT: OPC timeout/failed; continue attempt to read";
-    }
-    QVector<VNAcomand*> xCmds;
-    xCmds.append(new CALC_TRACE_DATA_XAXIS(_activeTraceNumbers.first()));
-    sendCommandImpl(_host, _port, xCmds);
-    for (int tr : _activeTraceNumbers) {
-        QVector<VNAcomand*> cmds;
-        cmds.append(new CALC_TRACE_SELECT(tr));
-        cmds.append(new CALC_TRACE_DATA_FDAT(tr));
-        sendCommandImpl(_host, _port, cmds);
+    if (_recordBacklog && !flushRecordBacklog()) {
+        _sweepTimer->start(RECORDER_RETRY_MS);
+        return;
+    }
+    if (_fetchPlan.isEmpty()) {
+        // трассы ещё не настроены — цикл продолжит setFetchPlan
+        return;
+    }
+    if (_segmentsDirty) applySegmentation();
+    _sweepRequested = false;
+    _sweepStartedNs = _clock.nsecsElapsed();
+    _segmentIndex = 0;
+    captureSweepMark(true, true);
+    triggerSegment();
+}
+
+void Socket::triggerSegment()
+{
+    _sweepState = SweepState::Triggering;
+    if (isSegmented()) {
+        // STAR/STOP/POIN сегмента: модель состояния отправит только отличия
+        enqueueConfiguration(_segments[_segmentIndex].setup);
+    }
+    qCDebug(lcSocket) << "startSweep: trigger, segment" << _segmentIndex;
+    enqueue(_triggerCommand);
+    requestOperationComplete(_opcTimeout, [this](bool ok) {
+        if (!ok) {
+            qCWarning(lcSocket) << "startSweep: OPC timeout/failed; continue attempt to read";
+        }
+        if (!_scanning || _reconnecting) {
+            _sweepState = SweepState::Idle;
+            _frame.reset();
+            _segmentFrame.reset();
+            return;
+        }
+        fetchSweepData();
+    });
+}
+
+void Socket::fetchSweepData()
+{
+    _sweepState = SweepState::Fetching;
+    const bool segmented = isSegmented();
+    if (_segmentIndex == 0) {
+        _frame = std::make_shared<SweepFrame>();
+        _frame->sequence = ++_sweepSequence;
+        _frame->settings = _scanSettings;
+        _frame->startedMs = QDateTime::currentMSecsSinceEpoch() - (_clock.nsecsElapsed() - _sweepStartedNs) / 1000000;
+        // какие трассы читать, решается один раз на свип: у сегментов один набор
+        _dueTraces.clear();
+        for (int i = 0; i < _traceCommands.size(); ++i) {
+            const TraceFetchCommands& trace = _traceCommands[i];
+            auto last = _lastTraces.constFind(trace.trace);
+            if (last != _lastTraces.constEnd() && _frame->sequence % quint64(trace.every) != quint64(trace.phase)) {
+                _frame->traces.insert(trace.trace, last.value());
+                _metrics.add(SocketMetrics::TraceFetchesSkipped);
+                continue;
+            }
+            _dueTraces.append(i);
+            _frame->refreshedTraces.append(trace.trace);
+        }
+    }
+    if (segmented) {
+        const SweepSegment& segment = _segments[_segmentIndex];
+        _segmentFrame = std::make_shared<SweepFrame>();
+        _segmentFrame->sequence = _frame->sequence;
+        _segmentFrame->startedMs = _frame->startedMs;
+        _segmentFrame->settings = _scanSettings;
+        if (_frequencyKHz.size() == _scanSettings.points) {
+            _segmentFrame->frequencyKHz = _frequencyKHz.mid(segment.firstPoint, segment.points);
+        }
+    }
+
+    // Команды собраны заранее (rebuildSweepCommands), здесь только очередь.
+    // Ось X читается только после перенастройки, трассы — по плану.
+    // Сегмент кладёт свою часть и в _segmentFrame, и в хвост _frame.
+    if (segmented ? _segmentFrame->frequencyKHz.isEmpty() : _frequencyKHz.isEmpty()) {
+        enqueue(_xaxisCommand, [this, format = _dataFormat, littleEndian = _littleEndian](bool ok, const QByteArray& reply) {
+            if (!ok || !_frame) return;
+            const qint64 parseStartNs = _clock.nsecsElapsed();
+            const QVector<double> axis = parseFrequencyKHz(reply, format, littleEndian);
+            if (_segmentFrame) {
+                _segmentFrame->frequencyKHz = axis;
+            } else {
+                _frequencyKHz = axis;
+            }
+            _frame->frequencyKHz += axis;
+            _metrics.record(SocketMetrics::ParseTime, (_clock.nsecsElapsed() - parseStartNs) / 1000);
+        });
+    } else if (segmented) {
+        _frame->frequencyKHz += _segmentFrame->frequencyKHz;
+    } else {
+        _frame->frequencyKHz = _frequencyKHz;
+    }
+    for (int index : _dueTraces) {
+        const TraceFetchCommands& trace = _traceCommands[index];
+        const int tr = trace.trace;
+        enqueue(trace.select);
+        enqueue(trace.fdat, [this, tr, format = _dataFormat, littleEndian = _littleEndian](bool ok, const QByteArray& reply) {
+            if (!ok || !_frame) return;
+            const qint64 parseStartNs = _clock.nsecsElapsed();
+            const ComplexTrace data = parseReply<ScpiId::TraceData>(reply, format, littleEndian);
+            if (_segmentFrame) {
+                _segmentFrame->traces.insert(tr, data);
+                _frame->traces[tr].append(data);
+            } else {
+                _frame->traces.insert(tr, data);
+            }
+            _metrics.record(SocketMetrics::ParseTime, (_clock.nsecsElapsed() - parseStartNs) / 1000);
+        });
+    }
+    enqueueBarrier([this, segmented](bool ok, const QByteArray&) {
+        if (segmented) {
+            onSegmentFetched(ok);
+        } else {
+            onSweepFetched(ok);
+        }
+    });
+    flushOutgoing();
+}
+
+void Socket::onSegmentFetched(bool ok)
+{
+    std::shared_ptr<SweepFrame> segment = std::move(_segmentFrame);
+    _segmentFrame.reset();
+    const SweepSegment& part = _segments[_segmentIndex];
+    if (ok && segment && !segment->traces.isEmpty()) {
+        if (_segmentIndex == 0) {
+            _metrics.record(SocketMetrics::FirstSegmentTime, (_clock.nsecsElapsed() - _sweepStartedNs) / 1000);
+        }
+        segment->completedMs = QDateTime::currentMSecsSinceEpoch();
+        emit sweepSegmentReady(SweepFramePtr(std::move(segment)), part.firstPoint, _scanSettings.points);
+    }
+    ++_segmentIndex;
+    if (!ok || !_frame || _segmentIndex >= _segments.size()) {
+        onSweepFetched(ok);
+        return;
+    }
+    if (!_scanning || _reconnecting) {
+        // остаток свипа не нужен; resumeScan начнёт новый с первого сегмента
+        _frame.reset();
+        _sweepState = SweepState::Idle;
+        return;
+    }
+    triggerSegment();
+}
+
+void Socket::onSweepFetched(bool ok)
+{
+    const qint64 sweepUs = (_clock.nsecsElapsed() - _sweepStartedNs) / 1000;
+    qCDebug(lcSocket) << "Sweep fetched in" << sweepUs / 1000 << "ms";
+    std::shared_ptr<SweepFrame> frame = std::move(_frame);
+    _frame.reset();
+    if (ok && frame && isSegmented()) {
+        // трасса, у которой не дочитался какой-то сегмент, в кадр не попадает
+        const qsizetype points = frame->frequencyKHz.size();
+        for (auto it = frame->traces.begin(); it != frame->traces.end();) {
+            if (it.value().size() == points) {
+                ++it;
+                continue;
+            }
+            it = frame->traces.erase(it);
+        }
+        if (points == _scanSettings.points) _frequencyKHz = frame->frequencyKHz;
+    }
+    captureSweepMark(false, ok && frame && !frame->traces.isEmpty());
+    if (ok && frame && !frame->traces.isEmpty()) {
+        const qsizetype points = frame->traces.first().size();
+        QVector<int> refreshed;
+        for (int tr : frame->refreshedTraces) {
+            auto it = frame->traces.constFind(tr);
+            if (it == frame->traces.constEnd()) continue;   // FDAT? не дошёл
+            _lastTraces.insert(tr, it.value());
+            refreshed.append(tr);
+        }
+        frame->refreshedTraces = refreshed;
+        if (frame->refreshedTraces.size() == frame->traces.size()) frame->refreshedTraces.clear();
+        if (frame->frequencyKHz.size() != points) {
+            // число точек изменилось без startScan — ось перечитать в следующем свипе
+            _frequencyKHz.clear();
+            frame->frequencyKHz.resize(points);
+            for (qsizetype i = 0; i < points; ++i)
+                frame->frequencyKHz[i] = double(i);
+        }
+        frame->completedMs = QDateTime::currentMSecsSinceEpoch();
+        _metrics.record(SocketMetrics::SweepTime, sweepUs);
+        _metrics.add(SocketMetrics::SweepsCompleted);
+        SweepFramePtr ready(std::move(frame));
+        if (SweepRecorder* recorder = _recorder.load(std::memory_order_acquire)) {
+            if (!recorder->submit(ready) && recorder->isRecording()) {
+                // запись без потерь: кадр ждёт места в кольце, следующий свип — тоже
+                _recordBacklog = ready;
+                _backlogRecorder = recorder;
+                _metrics.add(SocketMetrics::RecorderStalls);
+            }
+        }
+        // отображение — только последний свип: недобранный GUI вытесняется
+        if (!publishSweep(ready)) _metrics.add(SocketMetrics::DisplaySweepsDropped);
+    } else if (_scanning && !_reconnecting) {
+        emit sweepAborted();
+    }
+    _sweepState = SweepState::Idle;
+    scheduleNextSweep();
+}
+
+bool Socket::flushRecordBacklog()
+{
+    SweepRecorder* recorder = _recorder.load(std::memory_order_acquire);
+    if (recorder && recorder == _backlogRecorder && recorder->isRecording()) {
+        if (!recorder->submit(_recordBacklog)) return false;
+    } else {
+        qCWarning(lcSocket) << "Recording stopped with a sweep still waiting for the recorder";
+    }
+    _recordBacklog.reset();
+    _backlogRecorder = nullptr;
+    return true;
+}
+
+void Socket::scheduleNextSweep()
+{
+    if (!_scanning || _reconnecting || !_sweepTimer || _sweepState != SweepState::Idle) {
+        return;
+    }
+    if (_externalTrigger && !_sweepRequested) {
+        return;
+    }
+    // следующий свип стартует сразу после чтения данных, не чаще _minSweepInterval
+    const qint64 sinceStartMs = (_clock.nsecsElapsed() - _sweepStartedNs) / 1000000;
+    const qint64 delay = qMax<qint64>(0, _minSweepInterval - sinceStartMs);
+    _sweepTimer->start(int(delay));
+}
+
+void Socket::requestSweep()
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, "requestSweep", Qt::QueuedConnection);
+        return;
     }
-    qDebug() << "requestFDAT: finished";
-    busy = false;
+    _sweepRequested = true;
+    scheduleNextSweep();
 }
 
 void Socket::onConnected()
 {
-    qDebug() << "Socket: connected to" << _host.toString() << ":" << _port;
+    qCDebug(lcSocket) << "Socket: connected to" << _host.toString() << ":" << _port;
+    _connecting = false;
+    if (_connectTimer) _connectTimer->stop();
+    configureSocketOptions();
+    _metrics.add(SocketMetrics::Connections);
+    _reconnectAttempts = 0;
+    _lastActivityNs = _clock.nsecsElapsed();
+    if (_healthTimer) _healthTimer->start(HEALTH_CHECK_INTERVAL_MS);
     emit connected();
+    if (_reconnecting && _scanning) {
+        resumeScan();
+    }
+    flushOutgoing();
 }
 
 void Socket::onDisconnected()
 {
-    qDebug() << "Socket: disconnected";
-    _scanning = false;
-    if (_fdatTimer && _fdatTimer->isActive()) _fdatTimer->stop();
+    qCDebug(lcSocket) << "Socket: disconnected";
+    _metrics.add(SocketMetrics::Disconnections);
     emit disconnected();
+    // о разрыве уже сообщил errorOccurred; при скане связь восстанавливается
+    connectionLost(QAbstractSocket::RemoteHostClosedError, QString());
 }
 
-bool Socket::canConnect(const QString &ip, quint16 port)
+void Socket::setTraceSetup(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands)
 {
-    QTcpSocket probe;
-    probe.connectToHost(ip, port);
-    bool ok = probe.waitForConnected(3000);
-    if (ok) {
-        if (probe.state() != QAbstractSocket::UnconnectedState) {
-            probe.disconnectFromHost();
-            probe.waitForDisconnected(1000);
-        }
-    } else {
-        qWarning() << "canConnect: failed to connect to" << ip << port << "err:" << probe.errorString();
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, host, port, commands]() {
+            setTraceSetup(host, port, commands);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    _setupCommands = commands;
+    // формат трасс мог измениться — прежние данные не годятся
+    _frequencyKHz.clear();
+    _lastTraces.clear();
+    if (!ensureConnection(host, port)) {
+        return;
+    }
+    enqueueConfiguration(commands);
+    if (_verifyConfiguration && _stateKnown) enqueueVerification();
+    flushOutgoing();
+}
+
+void Socket::rebuildSweepCommands()
+{
+    _traceCommands.clear();
+    _xaxisCommand = ScpiCommand();
+    if (_fetchPlan.isEmpty()) return;
+    _xaxisCommand = makeScpi<ScpiId::TraceXAxis>(_fetchPlan.first().trace);
+    _traceCommands.reserve(_fetchPlan.size());
+    for (const TraceFetchPlan& plan : _fetchPlan) {
+        TraceFetchCommands trace;
+        trace.trace = plan.trace;
+        trace.every = qMax(1, plan.every);
+        trace.phase = plan.phase % trace.every;
+        trace.select = makeScpi<ScpiId::ParameterSelect>(plan.trace);
+        trace.fdat = makeScpi<ScpiId::TraceData>(plan.trace);
+        _traceCommands.append(trace);
+    }
+}
+
+void Socket::rebuildSegments()
+{
+    _segments.clear();
+    const int total = _scanSettings.points;
+    if (_segmentPoints <= 0 || total <= _segmentPoints) return;
+    // Сегменты делят общую сетку без перекрытий: склеенные, они дают ту же
+    // ось, что и свип целиком. Точки распределяются поровну.
+    const int count = (total + _segmentPoints - 1) / _segmentPoints;
+    const double startHz = double(_scanSettings.startKHz) * 1000.0;
+    const double stepHz = (double(_scanSettings.stopKHz) - _scanSettings.startKHz) * 1000.0 / (total - 1);
+    _segments.reserve(count);
+    int first = 0;
+    for (int i = 0; i < count; ++i) {
+        SweepSegment segment;
+        segment.firstPoint = first;
+        segment.points = (total - first) / (count - i);
+        const int last = first + segment.points - 1;
+        segment.setup.append(makeScpi<ScpiId::FreqStart>(qRound64(startHz + stepHz * first)));
+        segment.setup.append(makeScpi<ScpiId::FreqStop>(qRound64(startHz + stepHz * last)));
+        segment.setup.append(makeScpi<ScpiId::SweepPoints>(segment.points));
+        _segments.append(segment);
+        first = last + 1;
+    }
+    qCDebug(lcSocket) << "Sweep of" << total << "points split into" << count << "segments";
+}
+
+void Socket::setSegmentPoints(int pointsPerSegment)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, pointsPerSegment]() { setSegmentPoints(pointsPerSegment); }, Qt::QueuedConnection);
+        return;
+    }
+    pointsPerSegment = pointsPerSegment > 0 ? qMax(pointsPerSegment, SEGMENT_MIN_POINTS) : 0;
+    if (_segmentPoints == pointsPerSegment) return;
+    _segmentPoints = pointsPerSegment;
+    // текущий свип дочитывается по прежнему делению, новое — со следующего
+    _segmentsDirty = true;
+    if (_sweepState == SweepState::Idle) applySegmentation();
+}
+
+void Socket::applySegmentation()
+{
+    _segmentsDirty = false;
+    const bool wasSegmented = isSegmented();
+    rebuildSegments();
+    if (wasSegmented && !isSegmented() && _scanning && _stateKnown) {
+        // прибор остался на последнем сегменте — вернуть полный диапазон
+        enqueueConfiguration(_scanCommands);
+        flushOutgoing();
     }
-    return ok;
 }
 
 void Socket::setGraphSettings(int graphCount, const QVector<int>& traceNumbers)
 {
-    _currentGraphCount = graphCount;
-    _activeTraceNumbers = traceNumbers;
-    qDebug() << "Socket::setGraphSettings: graphCount =" << graphCount
-             << ", traces =" << traceNumbers;
+    Q_UNUSED(graphCount)
+    QVector<TraceFetchPlan> plan;
+    plan.reserve(traceNumbers.size());
+    for (int tr : traceNumbers) {
+        TraceFetchPlan trace;
+        trace.trace = tr;
+        plan.append(trace);
+    }
+    setFetchPlan(plan);
+}
+
+void Socket::setFetchPlan(const QVector<TraceFetchPlan>& plan)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, plan]() { setFetchPlan(plan); }, Qt::QueuedConnection);
+        return;
+    }
+    const bool axisTraceChanged = plan.isEmpty() || _fetchPlan.isEmpty() || plan.first().trace != _fetchPlan.first().trace;
+    _fetchPlan = plan;
+    if (axisTraceChanged) _frequencyKHz.clear();
+    // данные трасс, оставшихся в плане, ещё годятся до их очереди
+    for (auto it = _lastTraces.begin(); it != _lastTraces.end();) {
+        bool kept = false;
+        for (const TraceFetchPlan& trace : plan) kept |= trace.trace == it.key();
+        if (kept) ++it;
+        else it = _lastTraces.erase(it);
+    }
+    rebuildSweepCommands();
+    scheduleNextSweep();
+    qCDebug(lcSocket) << "Socket::setFetchPlan:" << plan.size() << "traces";
 }
@@ -3,11 +3,67 @@
 
 #include "vnaclient.h"
 #include "vnacomand.h"
+#include "scpiframer.h"
+#include "socketmetrics.h"
 #include <QTcpSocket>
 #include <QTimer>
 #include <QThread>
 #include <QVector>
+#include <QQueue>
+#include <QHash>
 #include <QHostAddress>
+#include <QElapsedTimer>
+#include <atomic>
+#include <functional>
+
+class SweepRecorder;
+class SessionCapture;
+
+// Обработчик завершения команды: ok == false при таймауте или отмене.
+// Команда, к которой привязан обработчик, жива только пока он выполняется с ok == true.
+using ReplyHandler = std::function<void(bool ok, const QByteArray& reply)>;
+using OpcContinuation = std::function<void(bool ok)>;
+
+struct PendingCommand
+{
+    ScpiCommand command;            // пустая — барьер: срабатывает, когда все предыдущие ответы получены
+    ReplyHandler onReply;           // нет обработчика у запроса — ответ уходит в dataFromVNA
+    int timeoutMs = 0;
+    qint64 sentNs = 0;
+    bool cancelled = false;
+};
+
+// Последнее отправленное значение настройки прибора
+struct InstrumentSetting
+{
+    QByteArray scpi;
+    int trace = 0;
+};
+
+// Команды чтения одной трассы, собираются при смене набора трасс
+struct TraceFetchCommands
+{
+    int trace = 0;
+    int every = 1;
+    int phase = 0;
+    ScpiCommand select;
+    ScpiCommand fdat;
+};
+
+// Часть широкого свипа: точки [firstPoint, firstPoint + points) общей сетки
+struct SweepSegment
+{
+    int firstPoint = 0;
+    int points = 0;
+    QVector<ScpiCommand> setup;     // STAR/STOP/POIN сегмента, собираются при startScan
+};
+
+enum class SweepState
+{
+    Idle,
+    Triggering,
+    Fetching
+};
 
 class Socket : public VNAclient
 {
@@ -18,16 +74,44 @@ public:
     ~Socket();
 
     VNAclient* getInstance() override;
-    void setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int fdatIntervalMs);
+    // Сеттеры ниже можно вызывать из любого потока: применяются в потоке сокета
+    void setTimeouts(int normalTimeoutMs, int opcTimeoutMs, int minSweepIntervalMs);
+    // FORM:* уходит сразу; запросы, отправленные раньше, разбираются в прежнем формате
+    void setDataTransferMode(TraceDataFormat format, bool littleEndian);
+    // true — следующий свип стартует только по requestSweep() (общий планировщик нескольких приборов).
+    // Включение на ходу: текущий свип или ждущий таймера идёт без запроса
+    void setExternalSweepTrigger(bool external);
+    // Каждый готовый свип дополнительно отдаётся в recorder (nullptr — без записи).
+    // Запись без потерь: пока кольцо recorder полно, следующий свип не стартует
+    void setRecorder(SweepRecorder* recorder);
+    // Запись сырого обмена с прибором для ReplayClient; можно вызывать из любого потока
+    bool startCapture(const QString& path);
+    void stopCapture();
     void startThread();
     void stopThread();
     void setGraphSettings(int graphCount, const QVector<int>& traceNumbers) override;
-    bool canConnect(const QString &ip, quint16 port);
+    // Какие трассы читать в каком свипе; можно вызывать из любого потока
+    void setFetchPlan(const QVector<TraceFetchPlan>& plan);
+    // Проверять настройки запросами после каждой перенастройки
+    void setVerifyConfiguration(bool verify);
+    // Свип больше pointsPerSegment точек снимается по частям, каждая часть
+    // сразу уходит в sweepSegmentReady; 0 — всегда целиком. Из любого потока
+    void setSegmentPoints(int pointsPerSegment);
+
+    // Снимок можно брать из любого потока
+    const SocketMetrics& metrics() const { return _metrics; }
+    SocketMetrics& metrics() { return _metrics; }
+
+signals:
+    void operationComplete(quint64 token, bool ok);
 
 public slots:
-    void sendCommand(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands) override;
+    void sendCommand(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands) override;
     void startScan(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz) override;
     void stopScan() override;
+    void requestSweep();
+    // Настройка трасс: отправляется сейчас и повторяется после каждого переподключения
+    void setTraceSetup(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands);
 
 private slots:
     void initializeInThread();
@@ -35,25 +119,113 @@ private slots:
     void stopInThread();
     void onConnected();
     void onDisconnected();
-    void requestFDAT();
+    void onReadyRead();
+    void onReplyTimeout();
+    void onConnectTimeout();
+    void onHealthCheck();
+    void reconnect();
+    void startSweep();
 
 private:
-    void sendCommandImpl(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands);
+    void sendCommandImpl(const QHostAddress& host, quint16 port, const QVector<ScpiCommand>& commands);
     bool ensureConnection(const QHostAddress& host, quint16 port);
-    bool waitForOperationsComplete(int timeoutMs);
-    void sendCommandWithOPC(const QHostAddress& host, quint16 port, const QVector<VNAcomand*>& commands);
+    void startConnecting();
+    void configureSocketOptions();
+    void connectionLost(int code, const QString& reason);
+    void resumeScan();
+    quint64 requestOperationComplete(int timeoutMs, OpcContinuation continuation = OpcContinuation());
+    bool rememberSetting(const ScpiCommand& command);
+    void enqueueConfiguration(const QVector<ScpiCommand>& commands);
+    QVector<ScpiCommand> dataFormatCommands() const;
+    void applyScanConfiguration();
+    void enqueueVerification();
+    void triggerSegment();
+    void fetchSweepData();
+    void onSegmentFetched(bool ok);
+    void onSweepFetched(bool ok);
+    void scheduleNextSweep();
+    bool flushRecordBacklog();
+
+    void enqueue(const ScpiCommand& command, ReplyHandler onReply = ReplyHandler(), int timeoutMs = 0);
+    void enqueueBarrier(ReplyHandler onReached);
+    void flushOutgoing();
+    void cancelPending();
+    void dispatchReply(const QByteArray& reply);
+    void runReachedBarriers();
+    void armReplyTimer();
+    void resynchronize();
+    int replyTimeoutFor(const ScpiCommand& command) const;
+    void rebuildSweepCommands();
+    void rebuildSegments();
+    void applySegmentation();
+    bool isSegmented() const { return _segments.size() > 1; }
+
+    void logCommandStats() const;
+    void captureSweepMark(bool begin, bool ok);
 
     QTcpSocket* _socket;
-    QTimer* _fdatTimer;
+    ScpiFramer _framer;
+    bool _resyncing;                // ждём эха _resyncNonce, прочее отбрасывается
+    int _resyncNonce;               // 2..255: не "0"/"1", которые шлют *OPC? и запросы настроек
+    quint64 _opcToken;
+    QQueue<PendingCommand> _outgoing;
+    QQueue<PendingCommand> _awaiting;
+    QTimer* _replyTimer;
+    QElapsedTimer _clock;
+    QByteArray _writeBuffer;
+    SocketMetrics _metrics;
+    QTimer* _sweepTimer;
+    QTimer* _connectTimer;
+    QTimer* _reconnectTimer;
+    QTimer* _healthTimer;
     QThread* _thread;
 
+    bool _connecting;               // connectToHost() вызван, connected ещё не пришёл
+    bool _reconnecting;             // связь потеряна во время скана, настройка будет восстановлена
+    int _reconnectAttempts;
+    qint64 _lastActivityNs;         // последний приём от прибора
+    bool _healthProbePending;
+
+    // Модель состояния прибора: заголовок настройки -> последняя отправленная команда.
+    // Повторная настройка отправляет только отличия.
+    QHash<QByteArray, InstrumentSetting> _instrumentState;
+    bool _stateKnown;               // после SYST:PRES на этом соединении
+    bool _verifyConfiguration;      // читать настройки обратно и исправлять расхождения
+
     bool _scanning;
-    int _currentGraphCount;
-    QVector<int> _activeTraceNumbers;
+    bool _externalTrigger;
+    bool _sweepRequested;
+    SweepState _sweepState;
+    qint64 _sweepStartedNs;
+    quint64 _sweepSequence;
+    std::shared_ptr<SweepFrame> _frame;
+    ScanParameters _scanSettings;
+    QVector<ScpiCommand> _scanCommands;     // последний набор startScan, без *OPC?
+    QVector<ScpiCommand> _setupCommands;    // последний setTraceSetup
+    std::atomic<SweepRecorder*> _recorder;
+    SweepFramePtr _recordBacklog;           // свип, не поместившийся в кольцо записи
+    SweepRecorder* _backlogRecorder;        // только для сравнения: recorder мог смениться
+    SessionCapture* _capture;
+    QVector<TraceFetchPlan> _fetchPlan;
+    QVector<double> _frequencyKHz;          // ось X не меняется между свипами, XAXIS? — после перенастройки
+    QMap<int, ComplexTrace> _lastTraces;    // для трасс, пропущенных планом в этом свипе
+    ScpiCommand _triggerCommand;
+    ScpiCommand _opcCommand;
+    ScpiCommand _xaxisCommand;
+    QVector<TraceFetchCommands> _traceCommands;
+    int _segmentPoints;                     // 0 — свип без сегментов
+    QVector<SweepSegment> _segments;        // пусто или больше одного
+    int _segmentIndex;
+    bool _segmentsDirty;                    // _segmentPoints сменился во время свипа
+    QVector<int> _dueTraces;                // индексы _traceCommands, читаемые в этом свипе
+    std::shared_ptr<SweepFrame> _segmentFrame;
 
     int _normalTimeout;
     int _opcTimeout;
-    int _fdatInterval;
+    int _minSweepInterval;
+
+    TraceDataFormat _dataFormat;
+    bool _littleEndian;
 
     QHostAddress _host;
     quint16 _port;
@@ -0,0 +1,183 @@
+#include "socketmetrics.h"
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QVariantList>
+#include <QtAlgorithms>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(qint64 us)
+{
+    if (us < 0) us = 0;
+    const int bucket = us == 0 ? 0 : qMin(BucketCount - 1, 64 - int(qCountLeadingZeroBits(quint64(us))));
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _totalUs.fetch_add(us, std::memory_order_relaxed);
+    // писатель один, поэтому обычного сравнения достаточно
+    if (us > _maxUs.load(std::memory_order_relaxed))
+        _maxUs.store(us, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : _buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _totalUs.store(0, std::memory_order_relaxed);
+    _maxUs.store(0, std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::percentileUs(double p) const
+{
+    quint64 buckets[BucketCount];
+    quint64 total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += buckets[i];
+    }
+    if (total == 0) return 0;
+    const quint64 rank = quint64(p * double(total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // верхняя граница корзины, но не больше наблюдавшегося максимума
+            const qint64 upper = i == 0 ? 0 : (qint64(1) << i) - 1;
+            return qMin(upper, maxUs());
+        }
+    }
+    return maxUs();
+}
+
+QVariantMap LatencyHistogram::snapshot() const
+{
+    const quint64 n = count();
+    QVariantMap map;
+    map.insert("count", n);
+    map.insert("avgUs", n ? totalUs() / qint64(n) : 0);
+    map.insert("p50Us", percentileUs(0.50));
+    map.insert("p99Us", percentileUs(0.99));
+    map.insert("maxUs", maxUs());
+    return map;
+}
+
+SocketMetrics::SocketMetrics()
+{
+    for (auto& counter : _counters)
+        counter.store(0, std::memory_order_relaxed);
+    _commandCount.store(0, std::memory_order_relaxed);
+    _commandsUntracked.store(0, std::memory_order_relaxed);
+}
+
+const char* SocketMetrics::counterName(Counter counter)
+{
+    switch (counter) {
+    case CommandsSent: return "commandsSent";
+    case BytesSent: return "bytesSent";
+    case RepliesReceived: return "repliesReceived";
+    case BytesReceived: return "bytesReceived";
+    case SweepsCompleted: return "sweepsCompleted";
+    case SweepsSkippedBusy: return "sweepsSkippedBusy";
+    case ReplyTimeouts: return "replyTimeouts";
+    case StaleReplies: return "staleReplies";
+    case Connections: return "connections";
+    case Disconnections: return "disconnections";
+    case ReconnectAttempts: return "reconnectAttempts";
+    case HealthChecksFailed: return "healthChecksFailed";
+    case TraceFetchesSkipped: return "traceFetchesSkipped";
+    case SettingsSkipped: return "settingsSkipped";
+    case SettingMismatches: return "settingMismatches";
+    case DisplaySweepsDropped: return "displaySweepsDropped";
+    case RecorderStalls: return "recorderStalls";
+    case Resyncs: return "resyncs";
+    case CounterCount: break;
+    }
+    return "";
+}
+
+const char* SocketMetrics::timingName(Timing timing)
+{
+    switch (timing) {
+    case SweepTime: return "sweepTime";
+    case OpcWait: return "opcWait";
+    case ParseTime: return "parseTime";
+    case FirstSegmentTime: return "firstSegmentTime";
+    case TimingCount: break;
+    }
+    return "";
+}
+
+void SocketMetrics::recordCommand(const QByteArray& header, qint64 roundTripUs)
+{
+    // Слоты заполняются только потоком сокета; читатель видит слот после
+    // публикации счётчика _commandCount (release/acquire).
+    const int used = _commandCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < used; ++i) {
+        if (_commands[i].header == header) {
+            _commands[i].roundTrip.record(roundTripUs);
+            return;
+        }
+    }
+    if (used == MaxCommandSlots) {
+        _commandsUntracked.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _commands[used].header = header;
+    _commands[used].roundTrip.record(roundTripUs);
+    _commandCount.store(used + 1, std::memory_order_release);
+}
+
+void SocketMetrics::reset()
+{
+    for (auto& counter : _counters)
+        counter.store(0, std::memory_order_relaxed);
+    for (auto& timing : _timings)
+        timing.reset();
+    const int used = _commandCount.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i)
+        _commands[i].roundTrip.reset();
+    _commandsUntracked.store(0, std::memory_order_relaxed);
+}
+
+QVariantMap SocketMetrics::snapshot() const
+{
+    QVariantMap map;
+    for (int i = 0; i < CounterCount; ++i)
+        map.insert(counterName(Counter(i)), value(Counter(i)));
+    const quint64 connections = value(Connections);
+    map.insert("reconnects", connections > 0 ? connections - 1 : 0);
+
+    for (int i = 0; i < TimingCount; ++i)
+        map.insert(timingName(Timing(i)), _timings[i].snapshot());
+
+    QVariantList commands;
+    const int used = _commandCount.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i) {
+        QVariantMap command = _commands[i].roundTrip.snapshot();
+        command.insert("header", QString::fromLatin1(_commands[i].header));
+        commands.append(command);
+    }
+    map.insert("commands", commands);
+    map.insert("commandsUntracked", _commandsUntracked.load(std::memory_order_relaxed));
+    return map;
+}
+
+QByteArray SocketMetrics::toJson() const
+{
+    QJsonObject root = QJsonObject::fromVariantMap(snapshot());
+    root.insert("timestamp", QDateTime::currentDateTime().toString(Qt::ISODateWithMs));
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+bool SocketMetrics::dumpToFile(const QString& path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(toJson());
+    return file.commit();
+}
@@ -0,0 +1,104 @@
+#ifndef SOCKETMETRICS_H
+#define SOCKETMETRICS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariantMap>
+#include <atomic>
+
+// Гистограмма времени в мкс с логарифмическими корзинами: корзина i
+// содержит значения [2^(i-1), 2^i). Пишет один поток, читать можно из любого —
+// все поля атомарные, блокировок нет.
+class LatencyHistogram
+{
+public:
+    static constexpr int BucketCount = 32;
+
+    LatencyHistogram();
+
+    void record(qint64 us);
+    void reset();
+
+    quint64 count() const { return _count.load(std::memory_order_relaxed); }
+    qint64 totalUs() const { return _totalUs.load(std::memory_order_relaxed); }
+    qint64 maxUs() const { return _maxUs.load(std::memory_order_relaxed); }
+    qint64 percentileUs(double p) const;
+    QVariantMap snapshot() const;
+
+private:
+    std::atomic<quint64> _buckets[BucketCount];
+    std::atomic<quint64> _count;
+    std::atomic<qint64> _totalUs;
+    std::atomic<qint64> _maxUs;
+};
+
+// Счётчики и гистограммы потока сокета. Запись — только из потока сокета,
+// снимок (snapshot/toJson) можно брать из GUI в любой момент.
+class SocketMetrics
+{
+public:
+    enum Counter {
+        CommandsSent,
+        BytesSent,
+        RepliesReceived,
+        BytesReceived,
+        SweepsCompleted,
+        SweepsSkippedBusy,
+        ReplyTimeouts,
+        StaleReplies,
+        Connections,
+        Disconnections,
+        ReconnectAttempts,
+        HealthChecksFailed,
+        TraceFetchesSkipped,
+        SettingsSkipped,
+        SettingMismatches,
+        DisplaySweepsDropped,   // вытеснены следующим свипом, пока GUI был занят
+        RecorderStalls,         // свип отложен: кольцо записи полно
+        Resyncs,                // ответ не пришёл, очередь ответов пересинхронизирована
+        CounterCount
+    };
+
+    enum Timing {
+        SweepTime,
+        OpcWait,
+        ParseTime,
+        FirstSegmentTime,   // от TRIG:SING до первых данных на графике
+        TimingCount
+    };
+
+    static constexpr int MaxCommandSlots = 32;
+
+    SocketMetrics();
+
+    void add(Counter counter, quint64 value = 1)
+    {
+        _counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    quint64 value(Counter counter) const { return _counters[counter].load(std::memory_order_relaxed); }
+    void record(Timing timing, qint64 us) { _timings[timing].record(us); }
+    void recordCommand(const QByteArray& header, qint64 roundTripUs);
+    void reset();
+
+    QVariantMap snapshot() const;
+    QByteArray toJson() const;
+    bool dumpToFile(const QString& path) const;
+
+    static const char* counterName(Counter counter);
+    static const char* timingName(Timing timing);
+
+private:
+    struct CommandSlot
+    {
+        QByteArray header;             // не меняется после публикации слота
+        LatencyHistogram roundTrip;
+    };
+
+    std::atomic<quint64> _counters[CounterCount];
+    LatencyHistogram _timings[TimingCount];
+    CommandSlot _commands[MaxCommandSlots];
+    std::atomic<int> _commandCount;
+    std::atomic<quint64> _commandsUntracked;
+};
+
+#endif // SOCKETMETRICS_H
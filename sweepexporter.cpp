@@ -0,0 +1,343 @@
+#include "sweepexporter.h"
+#include "sweepfile.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <charconv>
+#include <cstring>
+
+#define EXPORT_CHUNK_BYTES (1024 * 1024)
+#define EXPORT_MAX_NUMBER_CHARS 32
+
+namespace {
+
+// Один свип без копирования: указатели в SweepFrame или в отображение файла записи
+struct SweepView
+{
+    quint64 sequence = 0;
+    qint64 startedMs = 0;
+    qsizetype points = 0;
+    const double* frequencyKHz = nullptr;
+    QVector<int> traces;
+    QVector<const double*> re;
+    QVector<const double*> im;
+};
+
+SweepView viewOf(const SweepFrame& frame)
+{
+    SweepView view;
+    view.sequence = frame.sequence;
+    view.startedMs = frame.startedMs;
+    view.frequencyKHz = frame.frequencyKHz.constData();
+    view.points = frame.frequencyKHz.size();
+    for (auto it = frame.traces.constBegin(); it != frame.traces.constEnd(); ++it) {
+        if (it->size() < view.points) view.points = it->size();
+        view.traces.append(it.key());
+        view.re.append(it->real().constData());
+        view.im.append(it->imag().constData());
+    }
+    return view;
+}
+
+SweepView viewOf(const SweepFileReader& reader, qsizetype index)
+{
+    SweepView view;
+    const SweepRecordHeader* header = reader.header(index);
+    if (!header) return view;
+    view.sequence = header->sequence;
+    view.startedMs = header->startedMs;
+    view.points = header->pointCount;
+    view.frequencyKHz = reader.frequencyKHz(index);
+    const qint32* ids = reader.traceIds(index);
+    for (quint32 t = 0; t < header->traceCount; ++t) {
+        view.traces.append(ids[t]);
+        view.re.append(reader.traceRe(index, t));
+        view.im.append(reader.traceIm(index, t));
+    }
+    return view;
+}
+
+// Текст копится в буфере фиксированного размера и уходит в файл целыми кусками
+class ChunkWriter
+{
+public:
+    ChunkWriter() : _pos(0) { _buffer.resize(EXPORT_CHUNK_BYTES); }
+    ~ChunkWriter() { close(); }
+
+    bool open(const QString& path)
+    {
+        _file.setFileName(path);
+        _pos = 0;
+        _error.clear();
+        if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            _error = QString("%1: %2").arg(path, _file.errorString());
+            return false;
+        }
+        return true;
+    }
+
+    bool close()
+    {
+        if (!_file.isOpen()) return _error.isEmpty();
+        flush();
+        _file.close();
+        return _error.isEmpty();
+    }
+
+    QString errorString() const { return _error; }
+
+    void put(char c)
+    {
+        reserve(1);
+        _buffer[_pos++] = c;
+    }
+
+    void put(const char* text)
+    {
+        const qsizetype length = qsizetype(std::strlen(text));
+        reserve(length);
+        std::memcpy(_buffer.data() + _pos, text, size_t(length));
+        _pos += length;
+    }
+
+    void put(const QByteArray& text)
+    {
+        reserve(text.size());
+        std::memcpy(_buffer.data() + _pos, text.constData(), size_t(text.size()));
+        _pos += text.size();
+    }
+
+    void put(double value)
+    {
+        // кратчайшее представление, которое читается обратно без потерь
+        reserve(EXPORT_MAX_NUMBER_CHARS);
+        char* begin = _buffer.data() + _pos;
+        _pos = std::to_chars(begin, begin + EXPORT_MAX_NUMBER_CHARS, value).ptr - _buffer.data();
+    }
+
+    void put(qint64 value)
+    {
+        reserve(EXPORT_MAX_NUMBER_CHARS);
+        char* begin = _buffer.data() + _pos;
+        _pos = std::to_chars(begin, begin + EXPORT_MAX_NUMBER_CHARS, value).ptr - _buffer.data();
+    }
+
+private:
+    void reserve(qsizetype bytes)
+    {
+        if (_pos + bytes > _buffer.size()) flush();
+        if (bytes > _buffer.size()) _buffer.resize(bytes);
+    }
+
+    void flush()
+    {
+        if (_pos == 0 || !_file.isOpen()) return;
+        if (_file.write(_buffer.constData(), _pos) != _pos && _error.isEmpty())
+            _error = QString("%1: %2").arg(_file.fileName(), _file.errorString());
+        _pos = 0;
+    }
+
+    QFile _file;
+    QByteArray _buffer;
+    qsizetype _pos;
+    QString _error;
+};
+
+void putTouchstoneHeader(ChunkWriter& out, const SweepView& view, const ExportOptions& options, const QVector<int>& traces)
+{
+    out.put(QString("! TAIR sweep %1, %2\n")
+                .arg(view.sequence)
+                .arg(QDateTime::fromMSecsSinceEpoch(view.startedMs).toString(Qt::ISODateWithMs)).toUtf8());
+    for (int trace : traces) {
+        out.put(QString("! Trace %1: %2 %3\n")
+                    .arg(trace)
+                    .arg(options.traceParameters.value(trace, "?"), options.traceFormats.value(trace, "?")).toUtf8());
+    }
+    out.put("# KHZ S RI R ");
+    out.put(options.referenceOhms);
+    out.put('\n');
+}
+
+bool writeTouchstone(const SweepView& view, const ExportOptions& options, bool manySweeps, QStringList& files, QString& error)
+{
+    // Touchstone — это re/im; скалярные форматы (дБ, фаза, КСВ) туда не пишутся
+    for (int trace : view.traces) {
+        const QString format = options.traceFormats.value(trace);
+        if (!ComplexTrace::isComplexFormat(format)) {
+            error = QString("Trace %1 is in %2 format; Touchstone needs SCOM, SMITH or POLar, export to CSV instead")
+                        .arg(trace)
+                        .arg(format.isEmpty() ? QString("unknown") : format);
+            return false;
+        }
+    }
+
+    const QString sweepBase = manySweeps ? QString("%1_%2").arg(options.basePath).arg(view.sequence) : options.basePath;
+
+    // .s2p, если трассы покрывают все четыре S-параметра, в порядке S11 S21 S12 S22
+    static const char* const twoPort[] = {"S11", "S21", "S12", "S22"};
+    QVector<int> columns;
+    for (const char* parameter : twoPort) {
+        for (qsizetype t = 0; t < view.traces.size(); ++t) {
+            if (options.traceParameters.value(view.traces[t]).compare(QLatin1String(parameter), Qt::CaseInsensitive) == 0) {
+                columns.append(int(t));
+                break;
+            }
+        }
+    }
+
+    QVector<QVector<int>> outputs;
+    QStringList paths;
+    if (columns.size() == 4) {
+        outputs.append(columns);
+        paths.append(sweepBase + ".s2p");
+    } else {
+        for (qsizetype t = 0; t < view.traces.size(); ++t) {
+            outputs.append(QVector<int>{int(t)});
+            paths.append(view.traces.size() > 1 ? QString("%1_tr%2.s1p").arg(sweepBase).arg(view.traces[t])
+                                                : sweepBase + ".s1p");
+        }
+    }
+
+    for (qsizetype o = 0; o < outputs.size(); ++o) {
+        ChunkWriter out;
+        if (!out.open(paths[o])) {
+            error = out.errorString();
+            return false;
+        }
+        QVector<int> traceNumbers;
+        for (int column : outputs[o]) traceNumbers.append(view.traces[column]);
+        putTouchstoneHeader(out, view, options, traceNumbers);
+        for (qsizetype i = 0; i < view.points; ++i) {
+            out.put(view.frequencyKHz[i]);
+            for (int column : outputs[o]) {
+                out.put(' ');
+                out.put(view.re[column][i]);
+                out.put(' ');
+                out.put(view.im[column][i]);
+            }
+            out.put('\n');
+        }
+        if (!out.close()) {
+            error = out.errorString();
+            return false;
+        }
+        files.append(paths[o]);
+    }
+    return true;
+}
+
+void putCsvHeader(ChunkWriter& out, const SweepView& view, const ExportOptions& options)
+{
+    out.put("sequence,started_ms,frequency_khz");
+    for (int trace : view.traces) {
+        const QString name = options.traceParameters.contains(trace)
+                                 ? QString("tr%1_%2").arg(trace).arg(options.traceParameters.value(trace))
+                                 : QString("tr%1").arg(trace);
+        out.put(QString(",%1_re,%1_im").arg(name).toUtf8());
+    }
+    out.put('\n');
+}
+
+void writeCsvRows(ChunkWriter& out, const SweepView& view)
+{
+    for (qsizetype i = 0; i < view.points; ++i) {
+        out.put(qint64(view.sequence));
+        out.put(',');
+        out.put(view.startedMs);
+        out.put(',');
+        out.put(view.frequencyKHz[i]);
+        for (qsizetype t = 0; t < view.traces.size(); ++t) {
+            out.put(',');
+            out.put(view.re[t][i]);
+            out.put(',');
+            out.put(view.im[t][i]);
+        }
+        out.put('\n');
+    }
+}
+
+} // namespace
+
+SweepExporter::SweepExporter(QObject* parent)
+    : QThread(parent)
+    , _cancel(false)
+{
+}
+
+SweepExporter::~SweepExporter()
+{
+    cancel();
+    wait();
+}
+
+bool SweepExporter::exportFrames(const QVector<SweepFramePtr>& frames, const ExportOptions& options)
+{
+    if (isRunning()) return false;
+    _options = options;
+    _frames = frames;
+    _recordingPath.clear();
+    _cancel.store(false, std::memory_order_relaxed);
+    start(QThread::LowPriority);
+    return true;
+}
+
+bool SweepExporter::exportRecording(const QString& recordingPath, const ExportOptions& options)
+{
+    if (isRunning()) return false;
+    _options = options;
+    _frames.clear();
+    _recordingPath = recordingPath;
+    _cancel.store(false, std::memory_order_relaxed);
+    start(QThread::LowPriority);
+    return true;
+}
+
+void SweepExporter::run()
+{
+    SweepFileReader reader;
+    if (!_recordingPath.isEmpty() && !reader.open(_recordingPath)) {
+        emit exportFinished(false, QStringList(), reader.errorString());
+        return;
+    }
+    const int total = _recordingPath.isEmpty() ? int(_frames.size()) : int(reader.count());
+    const bool manySweeps = total > 1;
+
+    QStringList files;
+    QString error;
+    ChunkWriter csv;
+    QVector<int> csvTraces;
+    if (_options.format == ExportFormat::Csv) {
+        const QString path = _options.basePath + ".csv";
+        if (!csv.open(path)) {
+            emit exportFinished(false, files, csv.errorString());
+            return;
+        }
+        files.append(path);
+    }
+
+    int done = 0;
+    for (; done < total && error.isEmpty(); ++done) {
+        if (_cancel.load(std::memory_order_relaxed)) {
+            error = "Export cancelled";
+            break;
+        }
+        const SweepView view = _recordingPath.isEmpty() ? viewOf(*_frames[done]) : viewOf(reader, done);
+        if (view.points == 0 || view.traces.isEmpty()) continue;
+        if (_options.format == ExportFormat::Touchstone) {
+            writeTouchstone(view, _options, manySweeps, files, error);
+        } else {
+            // набор трасс может поменяться посреди записи — тогда новый заголовок
+            if (view.traces != csvTraces) {
+                putCsvHeader(csv, view, _options);
+                csvTraces = view.traces;
+            }
+            writeCsvRows(csv, view);
+        }
+        emit progress(done + 1, total);
+    }
+    if (!csv.close() && error.isEmpty()) error = csv.errorString();
+
+    _frames.clear();
+    qDebug() << "SweepExporter:" << done << "of" << total << "sweeps," << files.size() << "files" << error;
+    emit exportFinished(error.isEmpty(), files, error);
+}
@@ -0,0 +1,55 @@
+#ifndef SWEEPEXPORTER_H
+#define SWEEPEXPORTER_H
+
+#include "sweepframe.h"
+#include <QMap>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+
+enum class ExportFormat
+{
+    Touchstone,     // .s2p, если есть S11/S21/S12/S22, иначе .s1p на каждую трассу
+    Csv             // один файл: строка на точку, столбцы re/im каждой трассы
+};
+
+struct ExportOptions
+{
+    ExportFormat format = ExportFormat::Csv;    // Touchstone — только для трасс в комплексных форматах
+    QString basePath;                   // без расширения
+    QMap<int, QString> traceParameters; // номер трассы -> "S11", "S21", ...
+    QMap<int, QString> traceFormats;    // номер трассы -> формат CALC:FORM
+    double referenceOhms = 50.0;
+};
+
+// Выгрузка свипов в отдельном потоке: текст собирается кусками в буфер и
+// пишется в файл, поэтому тысячи свипов не держат ни GUI, ни поток сокета.
+class SweepExporter : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SweepExporter(QObject* parent = nullptr);
+    ~SweepExporter();
+
+    // false — предыдущая выгрузка ещё идёт
+    bool exportFrames(const QVector<SweepFramePtr>& frames, const ExportOptions& options);
+    bool exportRecording(const QString& recordingPath, const ExportOptions& options);
+    void cancel() { _cancel.store(true, std::memory_order_relaxed); }
+
+signals:
+    void progress(int done, int total);
+    void exportFinished(bool ok, const QStringList& files, const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    ExportOptions _options;
+    QVector<SweepFramePtr> _frames;
+    QString _recordingPath;
+    std::atomic<bool> _cancel;
+};
+
+#endif // SWEEPEXPORTER_H
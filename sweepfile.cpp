@@ -0,0 +1,422 @@
+#include "sweepfile.h"
+#include <QDateTime>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#define SWEEP_FILE_CHUNK_BYTES (64ull * 1024 * 1024)
+
+static quint64 traceIdBytes(quint32 traceCount)
+{
+    return (quint64(traceCount) * sizeof(qint32) + 7) & ~quint64(7);
+}
+
+quint64 sweepRecordSize(quint32 traceCount, quint32 pointCount)
+{
+    return sizeof(SweepRecordHeader) + traceIdBytes(traceCount)
+           + quint64(pointCount) * sizeof(double) * (1 + 2 * quint64(traceCount));
+}
+
+quint64 sweepChecksum(const uchar* data, quint64 size)
+{
+    // Пословная сумма с перемешиванием: ловит недописанные страницы,
+    // стоит меньше одного такта на байт.
+    quint64 h = 0x9E3779B97F4A7C15ull ^ size;
+    const quint64 words = size / 8;
+    for (quint64 i = 0; i < words; ++i) {
+        quint64 w;
+        std::memcpy(&w, data + i * 8, 8);
+        h = (h ^ w) * 0x100000001B3ull;
+        h ^= h >> 29;
+    }
+    for (quint64 i = words * 8; i < size; ++i)
+        h = (h ^ data[i]) * 0x100000001B3ull;
+    return h;
+}
+
+const SweepRecordHeader* validSweepRecord(const uchar* base, quint64 size, quint64 offset)
+{
+    if (offset + sizeof(SweepRecordHeader) > size || offset % 8 != 0) return nullptr;
+    const auto* header = reinterpret_cast<const SweepRecordHeader*>(base + offset);
+    if (header->magic != SWEEP_RECORD_MAGIC || header->headerSize != sizeof(SweepRecordHeader)) return nullptr;
+    if (header->recordSize != sweepRecordSize(header->traceCount, header->pointCount)) return nullptr;
+    if (header->recordSize > size - offset) return nullptr;
+    const quint64 payload = header->recordSize - sizeof(SweepRecordHeader);
+    if (sweepChecksum(base + offset + sizeof(SweepRecordHeader), payload) != header->checksum) return nullptr;
+    return header;
+}
+
+SweepFileWriter::SweepFileWriter()
+    : _window(nullptr)
+    , _windowOffset(0)
+    , _windowSize(0)
+    , _writeOffset(0)
+    , _recordCount(0)
+{
+}
+
+SweepFileWriter::~SweepFileWriter()
+{
+    close();
+}
+
+bool SweepFileWriter::open(const QString& path)
+{
+    close();
+    _error.clear();
+    _recordCount = 0;
+    _file.setFileName(path);
+    _index.setFileName(path + ".idx");
+    if (!_file.open(QIODevice::ReadWrite)) {
+        _error = _file.errorString();
+        return false;
+    }
+    if (!_index.open(QIODevice::ReadWrite)) {
+        _error = _index.errorString();
+        _file.close();
+        return false;
+    }
+
+    if (_file.size() < qint64(sizeof(SweepFileHeader))) {
+        SweepFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, SWEEP_FILE_MAGIC, sizeof(header.magic));
+        header.version = SWEEP_FILE_VERSION;
+        header.headerSize = sizeof(SweepFileHeader);
+        header.createdMs = QDateTime::currentMSecsSinceEpoch();
+        _file.resize(0);
+        _index.resize(0);
+        if (_file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))) {
+            _error = _file.errorString();
+            close();
+            return false;
+        }
+        _file.flush();
+        _writeOffset = sizeof(SweepFileHeader);
+        return true;
+    }
+    return recover();
+}
+
+bool SweepFileWriter::recover()
+{
+    SweepFileHeader header;
+    _file.seek(0);
+    if (_file.read(reinterpret_cast<char*>(&header), sizeof(header)) != qint64(sizeof(header))
+        || std::memcmp(header.magic, SWEEP_FILE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SWEEP_FILE_VERSION) {
+        _error = QString("%1: not a sweep recording").arg(_file.fileName());
+        close();
+        return false;
+    }
+
+    const quint64 size = quint64(_file.size());
+    const uchar* data = _file.map(0, qint64(size));
+    if (!data) {
+        _error = _file.errorString();
+        close();
+        return false;
+    }
+
+    // Последняя целая запись из индекса, дальше — проход по данным:
+    // записи, дописанные до падения, но не попавшие в индекс, добавляются.
+    qint64 entries = _index.size() / qint64(sizeof(SweepIndexEntry));
+    quint64 offset = sizeof(SweepFileHeader);
+    while (entries > 0) {
+        SweepIndexEntry entry;
+        _index.seek((entries - 1) * qint64(sizeof(SweepIndexEntry)));
+        if (_index.read(reinterpret_cast<char*>(&entry), sizeof(entry)) == qint64(sizeof(entry))) {
+            if (const SweepRecordHeader* record = validSweepRecord(data, size, entry.offset)) {
+                offset = entry.offset + record->recordSize;
+                break;
+            }
+        }
+        --entries;
+    }
+    _index.resize(entries * qint64(sizeof(SweepIndexEntry)));
+    _index.seek(_index.size());
+    _recordCount = quint64(entries);
+
+    while (const SweepRecordHeader* record = validSweepRecord(data, size, offset)) {
+        if (!writeIndex(offset, record->sequence, record->startedMs)) break;
+        ++_recordCount;
+        offset += record->recordSize;
+    }
+    _file.unmap(const_cast<uchar*>(data));
+
+    _writeOffset = offset;
+    // хвост после последней целой записи (недописанная запись или
+    // заранее выделенное окно) больше не нужен
+    _file.resize(qint64(_writeOffset));
+    return true;
+}
+
+bool SweepFileWriter::ensureWindow(quint64 bytes)
+{
+    if (_window && _writeOffset + bytes <= _windowOffset + _windowSize) return true;
+    unmapWindow();
+    const quint64 size = qMax<quint64>(SWEEP_FILE_CHUNK_BYTES, (bytes + 4095) & ~quint64(4095));
+    if (quint64(_file.size()) < _writeOffset + size && !_file.resize(qint64(_writeOffset + size))) {
+        _error = _file.errorString();
+        return false;
+    }
+    _window = _file.map(qint64(_writeOffset), qint64(size));
+    if (!_window) {
+        _error = _file.errorString();
+        return false;
+    }
+    _windowOffset = _writeOffset;
+    _windowSize = size;
+    return true;
+}
+
+void SweepFileWriter::unmapWindow()
+{
+    if (_window) {
+        _file.unmap(_window);
+        _window = nullptr;
+    }
+    _windowOffset = 0;
+    _windowSize = 0;
+}
+
+bool SweepFileWriter::writeIndex(quint64 offset, quint64 sequence, qint64 startedMs)
+{
+    SweepIndexEntry entry;
+    entry.offset = offset;
+    entry.sequence = sequence;
+    entry.startedMs = startedMs;
+    if (_index.write(reinterpret_cast<const char*>(&entry), sizeof(entry)) != qint64(sizeof(entry))) {
+        _error = _index.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SweepFileWriter::append(const SweepFrame& frame)
+{
+    if (!_file.isOpen()) return false;
+    const quint32 traceCount = quint32(frame.traces.size());
+    const quint32 points = quint32(frame.frequencyKHz.size());
+    const quint64 recordSize = sweepRecordSize(traceCount, points);
+    if (!ensureWindow(recordSize)) return false;
+
+    uchar* record = _window + (_writeOffset - _windowOffset);
+    SweepRecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.headerSize = sizeof(SweepRecordHeader);
+    header.recordSize = recordSize;
+    header.sequence = frame.sequence;
+    header.startedMs = frame.startedMs;
+    header.completedMs = frame.completedMs;
+    header.startKHz = frame.settings.startKHz;
+    header.stopKHz = frame.settings.stopKHz;
+    header.points = frame.settings.points;
+    header.band = frame.settings.band;
+    header.powerDbM = frame.settings.powerDbM;
+    header.powerFreqKHz = frame.settings.powerFreqKHz;
+    header.traceCount = traceCount;
+    header.pointCount = points;
+    header.sampleType = SWEEP_SAMPLE_DOUBLE;
+
+    uchar* p = record + sizeof(SweepRecordHeader);
+    const quint64 idBytes = traceIdBytes(traceCount);
+    std::memset(p, 0, idBytes);
+    qint32* ids = reinterpret_cast<qint32*>(p);
+    quint32 t = 0;
+    for (auto it = frame.traces.constBegin(); it != frame.traces.constEnd(); ++it)
+        ids[t++] = it.key();
+    p += idBytes;
+
+    const size_t arrayBytes = size_t(points) * sizeof(double);
+    std::memcpy(p, frame.frequencyKHz.constData(), arrayBytes);
+    p += arrayBytes;
+    for (auto it = frame.traces.constBegin(); it != frame.traces.constEnd(); ++it) {
+        const ComplexTrace& trace = it.value();
+        const size_t have = size_t(qMin<qsizetype>(trace.size(), points)) * sizeof(double);
+        std::memcpy(p, trace.real().constData(), have);
+        std::memset(p + have, 0, arrayBytes - have);
+        p += arrayBytes;
+        std::memcpy(p, trace.imag().constData(), have);
+        std::memset(p + have, 0, arrayBytes - have);
+        p += arrayBytes;
+    }
+
+    header.checksum = sweepChecksum(record + sizeof(SweepRecordHeader), recordSize - sizeof(SweepRecordHeader));
+    std::memcpy(record, &header, sizeof(header));
+    // magic — последним: запись без него при восстановлении отбрасывается
+    std::atomic_thread_fence(std::memory_order_release);
+    const quint32 magic = SWEEP_RECORD_MAGIC;
+    std::memcpy(record, &magic, sizeof(magic));
+
+    const quint64 offset = _writeOffset;
+    _writeOffset += recordSize;
+    ++_recordCount;
+    return writeIndex(offset, frame.sequence, frame.startedMs);
+}
+
+void SweepFileWriter::close()
+{
+    unmapWindow();
+    if (_file.isOpen()) {
+        // отрезаем неиспользованную часть последнего окна
+        _file.resize(qint64(_writeOffset));
+        _file.close();
+    }
+    if (_index.isOpen()) {
+        _index.close();
+    }
+}
+
+SweepFileReader::SweepFileReader()
+    : _data(nullptr)
+    , _size(0)
+{
+}
+
+SweepFileReader::~SweepFileReader()
+{
+    close();
+}
+
+bool SweepFileReader::open(const QString& path)
+{
+    close();
+    _error.clear();
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+    _size = quint64(_file.size());
+    if (_size < sizeof(SweepFileHeader)) {
+        _error = QString("%1: not a sweep recording").arg(path);
+        close();
+        return false;
+    }
+    _data = _file.map(0, qint64(_size));
+    if (!_data) {
+        _error = _file.errorString();
+        close();
+        return false;
+    }
+    const auto* header = reinterpret_cast<const SweepFileHeader*>(_data);
+    if (std::memcmp(header->magic, SWEEP_FILE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SWEEP_FILE_VERSION) {
+        _error = QString("%1: not a sweep recording").arg(path);
+        close();
+        return false;
+    }
+    if (!loadIndex(path + ".idx")) rebuildIndex();
+    return true;
+}
+
+bool SweepFileReader::loadIndex(const QString& indexPath)
+{
+    QFile index(indexPath);
+    if (!index.open(QIODevice::ReadOnly)) return false;
+    const qint64 count = index.size() / qint64(sizeof(SweepIndexEntry));
+    _entries.resize(count);
+    if (index.read(reinterpret_cast<char*>(_entries.data()), count * qint64(sizeof(SweepIndexEntry)))
+        != count * qint64(sizeof(SweepIndexEntry))) {
+        _entries.clear();
+        return false;
+    }
+    // индекс мог пережить данные (файл обрезан) — проверяем последнюю запись
+    while (!_entries.isEmpty() && !validSweepRecord(_data, _size, _entries.last().offset))
+        _entries.removeLast();
+    return true;
+}
+
+void SweepFileReader::rebuildIndex()
+{
+    _entries.clear();
+    quint64 offset = sizeof(SweepFileHeader);
+    while (const SweepRecordHeader* record = validSweepRecord(_data, _size, offset)) {
+        SweepIndexEntry entry;
+        entry.offset = offset;
+        entry.sequence = record->sequence;
+        entry.startedMs = record->startedMs;
+        _entries.append(entry);
+        offset += record->recordSize;
+    }
+}
+
+void SweepFileReader::close()
+{
+    if (_data) {
+        _file.unmap(const_cast<uchar*>(_data));
+        _data = nullptr;
+    }
+    _size = 0;
+    _entries.clear();
+    if (_file.isOpen()) _file.close();
+}
+
+const SweepRecordHeader* SweepFileReader::header(qsizetype index) const
+{
+    if (!_data || index < 0 || index >= _entries.size()) return nullptr;
+    return reinterpret_cast<const SweepRecordHeader*>(_data + _entries[index].offset);
+}
+
+const qint32* SweepFileReader::traceIds(qsizetype index) const
+{
+    const SweepRecordHeader* h = header(index);
+    if (!h) return nullptr;
+    return reinterpret_cast<const qint32*>(reinterpret_cast<const uchar*>(h) + sizeof(SweepRecordHeader));
+}
+
+const double* SweepFileReader::frequencyKHz(qsizetype index) const
+{
+    const SweepRecordHeader* h = header(index);
+    if (!h) return nullptr;
+    return reinterpret_cast<const double*>(reinterpret_cast<const uchar*>(h) + sizeof(SweepRecordHeader)
+                                           + traceIdBytes(h->traceCount));
+}
+
+const double* SweepFileReader::traceRe(qsizetype index, quint32 trace) const
+{
+    const SweepRecordHeader* h = header(index);
+    if (!h || trace >= h->traceCount) return nullptr;
+    return frequencyKHz(index) + quint64(h->pointCount) * (1 + 2 * quint64(trace));
+}
+
+const double* SweepFileReader::traceIm(qsizetype index, quint32 trace) const
+{
+    const double* re = traceRe(index, trace);
+    return re ? re + header(index)->pointCount : nullptr;
+}
+
+SweepFramePtr SweepFileReader::frame(qsizetype index) const
+{
+    const SweepRecordHeader* h = header(index);
+    if (!h) return SweepFramePtr();
+    auto frame = std::make_shared<SweepFrame>();
+    frame->sequence = h->sequence;
+    frame->startedMs = h->startedMs;
+    frame->completedMs = h->completedMs;
+    frame->settings.startKHz = h->startKHz;
+    frame->settings.stopKHz = h->stopKHz;
+    frame->settings.points = h->points;
+    frame->settings.band = h->band;
+    frame->settings.powerDbM = h->powerDbM;
+    frame->settings.powerFreqKHz = h->powerFreqKHz;
+    const qsizetype points = h->pointCount;
+    const double* freq = frequencyKHz(index);
+    frame->frequencyKHz = QVector<double>(freq, freq + points);
+    const qint32* ids = traceIds(index);
+    for (quint32 t = 0; t < h->traceCount; ++t) {
+        const double* re = traceRe(index, t);
+        const double* im = re + points;
+        frame->traces.insert(ids[t], ComplexTrace(QVector<double>(re, re + points), QVector<double>(im, im + points)));
+    }
+    return frame;
+}
+
+qsizetype SweepFileReader::findTime(qint64 startedMs) const
+{
+    // первая запись, начатая не раньше startedMs
+    auto it = std::lower_bound(_entries.constBegin(), _entries.constEnd(), startedMs,
+                               [](const SweepIndexEntry& e, qint64 ms) { return e.startedMs < ms; });
+    return it == _entries.constEnd() ? -1 : qsizetype(it - _entries.constBegin());
+}
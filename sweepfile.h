@@ -0,0 +1,137 @@
+#ifndef SWEEPFILE_H
+#define SWEEPFILE_H
+
+#include "sweepframe.h"
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Формат файла записи свипов (*.tsweep), все поля в порядке байт хоста:
+//   SweepFileHeader (64 байта)
+//   записи подряд: SweepRecordHeader, номера трасс (int32, выровнены до 8),
+//   частоты double[points], затем для каждой трассы re double[points], im double[points]
+// Рядом лежит индекс (*.tsweep.idx) из SweepIndexEntry. Индекс можно
+// восстановить по данным; запись считается целой, только если у неё
+// выставлен magic и совпадает контрольная сумма.
+
+#define SWEEP_FILE_MAGIC "TAIRSWP1"
+#define SWEEP_FILE_VERSION 1
+#define SWEEP_RECORD_MAGIC 0x43525753u   // "SWRC"
+#define SWEEP_SAMPLE_DOUBLE 1
+
+struct SweepFileHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 headerSize;
+    qint64 createdMs;
+    quint8 reserved[40];
+};
+
+struct SweepRecordHeader
+{
+    quint32 magic;              // пишется последним: 0 — запись не завершена
+    quint32 headerSize;
+    quint64 recordSize;         // вместе с заголовком
+    quint64 checksum;           // по всему, что идёт после заголовка
+    quint64 sequence;
+    qint64 startedMs;
+    qint64 completedMs;
+    qint32 startKHz;
+    qint32 stopKHz;
+    qint32 points;
+    qint32 band;
+    double powerDbM;
+    qint32 powerFreqKHz;
+    quint32 traceCount;
+    quint32 pointCount;
+    quint32 sampleType;
+};
+
+struct SweepIndexEntry
+{
+    quint64 offset;
+    quint64 sequence;
+    qint64 startedMs;
+};
+
+static_assert(sizeof(SweepFileHeader) == 64, "sweep file header layout");
+static_assert(sizeof(SweepRecordHeader) % 8 == 0, "sweep record header must keep payload 8-byte aligned");
+
+quint64 sweepRecordSize(quint32 traceCount, quint32 pointCount);
+quint64 sweepChecksum(const uchar* data, quint64 size);
+// Проверяет запись по смещению offset в отображении файла размером size
+const SweepRecordHeader* validSweepRecord(const uchar* base, quint64 size, quint64 offset);
+
+// Запись в файл через отображение окна памяти. Окно растёт кусками по
+// SWEEP_FILE_CHUNK_BYTES, так что добавление свипа — это memcpy без
+// системных вызовов, кроме случая, когда окно кончилось.
+class SweepFileWriter
+{
+public:
+    SweepFileWriter();
+    ~SweepFileWriter();
+
+    // Существующий файл дописывается: недописанный хвост отбрасывается,
+    // индекс достраивается по данным.
+    bool open(const QString& path);
+    bool append(const SweepFrame& frame);
+    void close();
+
+    bool isOpen() const { return _file.isOpen(); }
+    quint64 recordCount() const { return _recordCount; }
+    quint64 bytesWritten() const { return _writeOffset; }
+    QString errorString() const { return _error; }
+
+private:
+    bool recover();
+    bool ensureWindow(quint64 bytes);
+    void unmapWindow();
+    bool writeIndex(quint64 offset, quint64 sequence, qint64 startedMs);
+
+    QFile _file;
+    QFile _index;
+    uchar* _window;
+    quint64 _windowOffset;
+    quint64 _windowSize;
+    quint64 _writeOffset;
+    quint64 _recordCount;
+    QString _error;
+};
+
+// Чтение записанного файла: весь файл отображается только для чтения,
+// записи доступны по номеру без копирования.
+class SweepFileReader
+{
+public:
+    SweepFileReader();
+    ~SweepFileReader();
+
+    bool open(const QString& path);
+    void close();
+
+    qsizetype count() const { return _entries.size(); }
+    const SweepIndexEntry& entry(qsizetype index) const { return _entries[index]; }
+    const SweepRecordHeader* header(qsizetype index) const;
+    const qint32* traceIds(qsizetype index) const;
+    const double* frequencyKHz(qsizetype index) const;
+    const double* traceRe(qsizetype index, quint32 trace) const;
+    const double* traceIm(qsizetype index, quint32 trace) const;
+
+    // Копия записи в виде SweepFrame (для подачи в общий конвейер)
+    SweepFramePtr frame(qsizetype index) const;
+    qsizetype findTime(qint64 startedMs) const;
+    QString errorString() const { return _error; }
+
+private:
+    bool loadIndex(const QString& indexPath);
+    void rebuildIndex();
+
+    QFile _file;
+    const uchar* _data;
+    quint64 _size;
+    QVector<SweepIndexEntry> _entries;
+    QString _error;
+};
+
+#endif // SWEEPFILE_H
@@ -0,0 +1,50 @@
+#ifndef SWEEPFRAME_H
+#define SWEEPFRAME_H
+
+#include "tracedata.h"
+#include <QMap>
+#include <QMetaType>
+#include <QVector>
+#include <memory>
+
+// Параметры, с которыми был запущен startScan
+struct ScanParameters
+{
+    int startKHz = 0;
+    int stopKHz = 0;
+    int points = 0;
+    int band = 0;
+    double powerDbM = 0.0;
+    int powerFreqKHz = 0;
+};
+
+// Как часто читать трассу: в свипах, где sequence % every == phase.
+// План составляет VnaController, выполняет Socket.
+struct TraceFetchPlan
+{
+    int trace = 0;
+    int every = 1;
+    int phase = 0;
+};
+
+// Один полный свип: ось X и все трассы. Собирается и разбирается в потоке
+// сокета и после отправки не меняется, поэтому передаётся потребителям
+// по указателю без копирования данных.
+struct SweepFrame
+{
+    quint64 sequence = 0;
+    qint64 startedMs = 0;
+    qint64 completedMs = 0;
+    ScanParameters settings;
+    QVector<double> frequencyKHz;
+    QMap<int, ComplexTrace> traces;
+    // трассы, прочитанные в этом свипе; остальные повторяют последние данные.
+    // Пусто — свежие все.
+    QVector<int> refreshedTraces;
+};
+
+using SweepFramePtr = std::shared_ptr<const SweepFrame>;
+
+Q_DECLARE_METATYPE(SweepFramePtr)
+
+#endif // SWEEPFRAME_H
@@ -0,0 +1,114 @@
+#include "sweeprecorder.h"
+#include <QDebug>
+#include <QMutexLocker>
+
+SweepRecorder::SweepRecorder(QObject* parent)
+    : QThread(parent)
+    , _ring(RECORDER_QUEUE_CAPACITY)
+    , _stopping(false)
+    , _sleeping(false)
+    , _recording(false)
+    , _recorded(0)
+    , _dropped(0)
+    , _bytesWritten(0)
+{
+}
+
+SweepRecorder::~SweepRecorder()
+{
+    close();
+}
+
+bool SweepRecorder::open(const QString& path)
+{
+    close();
+    if (!_writer.open(path)) {
+        QMutexLocker locker(&_mutex);
+        _error = _writer.errorString();
+        qWarning() << "SweepRecorder: cannot open" << path << ":" << _error;
+        return false;
+    }
+    _path = path;
+    _error.clear();
+    _stopping.store(false);
+    _recorded.store(_writer.recordCount(), std::memory_order_relaxed);
+    _dropped.store(0, std::memory_order_relaxed);
+    _bytesWritten.store(_writer.bytesWritten(), std::memory_order_relaxed);
+    _recording.store(true, std::memory_order_release);
+    start(QThread::LowPriority);
+    qDebug() << "SweepRecorder: recording to" << path << "existing records:" << _writer.recordCount();
+    return true;
+}
+
+void SweepRecorder::close()
+{
+    if (!isRunning()) {
+        _recording.store(false, std::memory_order_release);
+        _writer.close();
+        return;
+    }
+    {
+        QMutexLocker locker(&_mutex);
+        _stopping.store(true);
+        _wake.wakeOne();
+    }
+    // очередь дописывается до конца, затем поток закрывает файл
+    wait();
+    _recording.store(false, std::memory_order_release);
+    qDebug() << "SweepRecorder: closed" << _path << "records:" << recorded() << "dropped:" << dropped();
+}
+
+QString SweepRecorder::errorString() const
+{
+    QMutexLocker locker(&_mutex);
+    return _error;
+}
+
+bool SweepRecorder::submit(const SweepFramePtr& frame)
+{
+    if (!frame || !isRecording() || _stopping.load()) return false;
+    if (!_ring.tryPush(frame)) return false;
+    // release-записи _tail мало: без полного барьера чтение _sleeping может
+    // обогнать её, и обе стороны увидят старые значения (пара к барьеру в run())
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // блокировка только если поток записи уснул на пустом кольце
+    if (_sleeping.load()) {
+        QMutexLocker locker(&_mutex);
+        _wake.wakeOne();
+    }
+    return true;
+}
+
+void SweepRecorder::run()
+{
+    for (;;) {
+        SweepFramePtr frame;
+        if (!_ring.tryPop(frame)) {
+            QMutexLocker locker(&_mutex);
+            _sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // повторная проверка после _sleeping: submit() либо увидит флаг, либо кадр уже в кольце
+            while (_ring.isEmpty() && !_stopping.load())
+                _wake.wait(&_mutex);
+            _sleeping.store(false);
+            if (_ring.isEmpty()) break;
+            continue;
+        }
+        if (!_writer.append(*frame)) {
+            const QString message = _writer.errorString();
+            qWarning() << "SweepRecorder: write failed:" << message;
+            {
+                QMutexLocker locker(&_mutex);
+                _error = message;
+                _stopping.store(true);
+            }
+            _dropped.fetch_add(1 + _ring.clear(), std::memory_order_relaxed);
+            _recording.store(false, std::memory_order_release);
+            emit recorderError(message);
+            break;
+        }
+        _recorded.fetch_add(1, std::memory_order_relaxed);
+        _bytesWritten.store(_writer.bytesWritten(), std::memory_order_relaxed);
+    }
+    _writer.close();
+}
@@ -0,0 +1,62 @@
+#ifndef SWEEPRECORDER_H
+#define SWEEPRECORDER_H
+
+#include "sweepfile.h"
+#include "sweepframe.h"
+#include "sweepring.h"
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+#define RECORDER_QUEUE_CAPACITY 64
+
+// Запись свипов в отдельном потоке. submit() вызывается из потока сокета
+// и не ждёт диска: кадр кладётся в кольцо SweepQueue без блокировок.
+// Полное кольцо submit() не переполняет, а возвращает false — сокет
+// придерживает кадр и следующий свип, так что запись идёт без потерь.
+// dropped() — кадры, не записанные из-за ошибки диска.
+class SweepRecorder : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SweepRecorder(QObject* parent = nullptr);
+    ~SweepRecorder();
+
+    bool open(const QString& path);
+    void close();
+    bool isRecording() const { return _recording.load(std::memory_order_acquire); }
+    QString path() const { return _path; }
+    QString errorString() const;
+
+    bool submit(const SweepFramePtr& frame);
+
+    quint64 recorded() const { return _recorded.load(std::memory_order_relaxed); }
+    quint64 dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    quint64 bytesWritten() const { return _bytesWritten.load(std::memory_order_relaxed); }
+
+signals:
+    void recorderError(const QString& message);
+
+protected:
+    void run() override;
+
+private:
+    SweepFileWriter _writer;
+    QString _path;
+    QString _error;
+
+    mutable QMutex _mutex;
+    QWaitCondition _wake;
+    SweepQueue _ring;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _sleeping;    // поток ждёт _wake: писатель будит его под _mutex
+
+    std::atomic<bool> _recording;
+    std::atomic<quint64> _recorded;
+    std::atomic<quint64> _dropped;
+    std::atomic<quint64> _bytesWritten;
+};
+
+#endif // SWEEPRECORDER_H
@@ -0,0 +1,88 @@
+#include "sweepring.h"
+
+SweepMailbox::SweepMailbox()
+    : _middle(1)
+    , _back(0)
+    , _front(2)
+    , _published(0)
+    , _superseded(0)
+{
+}
+
+bool SweepMailbox::publish(SweepFramePtr frame)
+{
+    // в слоте писателя — кадр, который читатель отдал при прошлом take()
+    _slots[_back] = std::move(frame);
+    const quint8 previous = _middle.exchange(_back | FreshBit, std::memory_order_acq_rel);
+    _back = previous & IndexMask;
+    _published.fetch_add(1, std::memory_order_relaxed);
+    if (previous & FreshBit) {
+        _superseded.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+SweepFramePtr SweepMailbox::take()
+{
+    if (!(_middle.load(std::memory_order_acquire) & FreshBit)) return SweepFramePtr();
+    const quint8 previous = _middle.exchange(_front, std::memory_order_acq_rel);
+    _front = previous & IndexMask;
+    return _slots[_front];
+}
+
+static quint64 ringSize(int capacity)
+{
+    quint64 size = 2;
+    while (size < quint64(qMax(capacity, 2))) size <<= 1;
+    return size;
+}
+
+SweepQueue::SweepQueue(int capacity)
+    : _slots(int(ringSize(capacity)))
+    , _mask(ringSize(capacity) - 1)
+    , _head(0)
+    , _cachedTail(0)
+    , _tail(0)
+    , _cachedHead(0)
+{
+}
+
+bool SweepQueue::tryPush(const SweepFramePtr& frame)
+{
+    const quint64 tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cachedHead > _mask) {
+        _cachedHead = _head.load(std::memory_order_acquire);
+        if (tail - _cachedHead > _mask) return false;
+    }
+    _slots[int(tail & _mask)] = frame;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool SweepQueue::tryPop(SweepFramePtr& frame)
+{
+    const quint64 head = _head.load(std::memory_order_relaxed);
+    if (head == _cachedTail) {
+        _cachedTail = _tail.load(std::memory_order_acquire);
+        if (head == _cachedTail) return false;
+    }
+    // кадр освобождается в потоке читателя, а не при следующей записи в слот
+    frame = std::move(_slots[int(head & _mask)]);
+    _slots[int(head & _mask)].reset();
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool SweepQueue::isEmpty() const
+{
+    return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+}
+
+int SweepQueue::clear()
+{
+    int dropped = 0;
+    SweepFramePtr frame;
+    while (tryPop(frame)) ++dropped;
+    return dropped;
+}
@@ -0,0 +1,63 @@
+#ifndef SWEEPRING_H
+#define SWEEPRING_H
+
+#include "sweepframe.h"
+#include <QVector>
+#include <atomic>
+
+// Передача готовых свипов из потока сокета потребителям без блокировок.
+// У каждого потребителя свой канал с одним писателем и одним читателем,
+// слоты выделены заранее — память не растёт при медленном потребителе.
+
+// Отображение: побеждает последний свип. Тройной буфер — писатель и
+// читатель владеют каждый своим слотом, третий обменивается атомарно.
+class SweepMailbox
+{
+public:
+    SweepMailbox();
+
+    // Поток писателя. true — читатель уже забрал прошлый кадр и его надо
+    // разбудить; false — уведомление ещё в очереди, прошлый кадр вытеснен
+    bool publish(SweepFramePtr frame);
+    // Поток читателя. nullptr — нового кадра нет
+    SweepFramePtr take();
+
+    quint64 published() const { return _published.load(std::memory_order_relaxed); }
+    quint64 superseded() const { return _superseded.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr quint8 FreshBit = 0x4;
+    static constexpr quint8 IndexMask = 0x3;
+
+    SweepFramePtr _slots[3];
+    std::atomic<quint8> _middle;    // индекс обменного слота | FreshBit
+    quint8 _back;                   // слот писателя
+    quint8 _front;                  // слот читателя
+    std::atomic<quint64> _published;
+    std::atomic<quint64> _superseded;
+};
+
+// Запись: без потерь. Кольцо фиксированной ёмкости; полное кольцо писатель
+// видит по tryPush() == false и сам решает, как притормозить.
+class SweepQueue
+{
+public:
+    explicit SweepQueue(int capacity);
+
+    bool tryPush(const SweepFramePtr& frame);   // поток писателя
+    bool tryPop(SweepFramePtr& frame);          // поток читателя
+    bool isEmpty() const;
+    int capacity() const { return _slots.size(); }
+    // Читатель: сбросить всё, что не успел взять
+    int clear();
+
+private:
+    QVector<SweepFramePtr> _slots;
+    const quint64 _mask;
+    alignas(64) std::atomic<quint64> _head;     // пишет только читатель
+    quint64 _cachedTail;
+    alignas(64) std::atomic<quint64> _tail;     // пишет только писатель
+    quint64 _cachedHead;
+};
+
+#endif // SWEEPRING_H
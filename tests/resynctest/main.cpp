@@ -0,0 +1,133 @@
+#include "socket.h"
+#include "vnasimulator.h"
+#include <QElapsedTimer>
+#include <QTest>
+#include <QThread>
+
+#define TEST_START_KHZ 100
+#define TEST_STOP_KHZ 4800000
+#define TEST_POINTS 201
+
+// Симулятор в своём потоке, как в pipelinebench: Socket и тест его не блокируют
+class SimulatorHost
+{
+public:
+    explicit SimulatorHost(const SimulatorOptions& options)
+    {
+        _simulator = new VnaSimulator(options);
+        _simulator->moveToThread(&_thread);
+        _thread.start();
+        QMetaObject::invokeMethod(_simulator, [this]() { _listening = _simulator->listen(); },
+                                  Qt::BlockingQueuedConnection);
+    }
+    ~SimulatorHost()
+    {
+        QMetaObject::invokeMethod(_simulator, [this]() { delete _simulator; }, Qt::BlockingQueuedConnection);
+        _thread.quit();
+        _thread.wait();
+    }
+
+    bool listening() const { return _listening; }
+    quint16 port() const { return _simulator->serverPort(); }
+
+private:
+    QThread _thread;
+    VnaSimulator* _simulator = nullptr;
+    bool _listening = false;
+};
+
+class ResyncTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void lateOpcReplyAfterTriggerTimeout();
+    void droppedRepliesWithLatency();
+
+private:
+    // Свипы, пришедшие за timeoutMs; misattributed — кадры с чужими ответами
+    static int runScan(const SimulatorOptions& simOptions, int normalTimeoutMs, int opcTimeoutMs, int sweeps,
+                       int timeoutMs, int& misattributed, quint64& resyncs);
+};
+
+int ResyncTest::runScan(const SimulatorOptions& simOptions, int normalTimeoutMs, int opcTimeoutMs, int sweeps,
+                        int timeoutMs, int& misattributed, quint64& resyncs)
+{
+    SimulatorHost simulator(simOptions);
+    if (!simulator.listening()) return -1;
+
+    Socket* socket = new Socket();
+    socket->setTimeouts(normalTimeoutMs, opcTimeoutMs, 0);
+    socket->setGraphSettings(1, {1});
+    socket->startThread();
+
+    int received = 0;
+    misattributed = 0;
+    QObject context;
+    QObject::connect(socket, &VNAclient::sweepReady, &context, [&]() {
+        const SweepFramePtr frame = socket->takeSweep();
+        if (!frame) return;
+        ++received;
+        // ось X — ответ XAXIS?, трасса — FDAT?: сдвиг очереди ответов меняет и то и другое
+        const bool axisOk = frame->frequencyKHz.size() == TEST_POINTS
+                            && qAbs(frame->frequencyKHz.first() - TEST_START_KHZ) < 1e-3
+                            && qAbs(frame->frequencyKHz.last() - TEST_STOP_KHZ) < 1e-3;
+        const bool traceOk = frame->traces.value(1).size() == TEST_POINTS;
+        if (!axisOk || !traceOk) ++misattributed;
+    });
+
+    socket->startScan("127.0.0.1", simulator.port(), TEST_START_KHZ, TEST_STOP_KHZ, TEST_POINTS, 1000, -10.0, 1000);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (received < sweeps && elapsed.elapsed() < timeoutMs)
+        QTest::qWait(20);
+    socket->stopScan();
+    resyncs = socket->metrics().value(SocketMetrics::Resyncs);
+    socket->stopThread();
+    delete socket;
+    return received;
+}
+
+void ResyncTest::initTestCase()
+{
+    qRegisterMetaType<SweepFramePtr>("SweepFramePtr");
+    qRegisterMetaType<ScpiCommand>("ScpiCommand");
+    qRegisterMetaType<QVector<ScpiCommand>>("QVector<ScpiCommand>");
+    qRegisterMetaType<QHostAddress>();
+}
+
+void ResyncTest::lateOpcReplyAfterTriggerTimeout()
+{
+    // *OPC? после TRIG:SING ждёт конца свипа дольше таймаута: его "1"
+    // приходит уже во время пересинхронизации и не должна её завершить
+    SimulatorOptions options;
+    options.port = 0;
+    options.sweepTimeMs = 400;
+    options.pointTimeUs = 0;
+    int misattributed = 0;
+    quint64 resyncs = 0;
+    const int received = runScan(options, 3000, 150, 3, 20000, misattributed, resyncs);
+    QVERIFY(received >= 3);
+    QVERIFY(resyncs > 0);
+    QCOMPARE(misattributed, 0);
+}
+
+void ResyncTest::droppedRepliesWithLatency()
+{
+    SimulatorOptions options;
+    options.port = 0;
+    options.sweepTimeMs = 20;
+    options.pointTimeUs = 0;
+    options.latencyMs = 5;
+    options.dropRate = 0.05;
+    options.seed = 7;
+    int misattributed = 0;
+    quint64 resyncs = 0;
+    const int received = runScan(options, 300, 300, 20, 60000, misattributed, resyncs);
+    QVERIFY(received >= 20);
+    QCOMPARE(misattributed, 0);
+}
+
+QTEST_GUILESS_MAIN(ResyncTest)
+#include "main.moc"
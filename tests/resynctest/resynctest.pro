@@ -0,0 +1,36 @@
+QT = core network testlib
+CONFIG += console c++17 testcase
+CONFIG -= app_bundle
+
+TARGET = resynctest
+
+INCLUDEPATH += ../.. ../../vnasim
+
+SOURCES += \
+    main.cpp \
+    ../../scpiframer.cpp \
+    ../../scpiparser.cpp \
+    ../../sessioncapture.cpp \
+    ../../socket.cpp \
+    ../../socketmetrics.cpp \
+    ../../sweepfile.cpp \
+    ../../sweeprecorder.cpp \
+    ../../sweepring.cpp \
+    ../../tracedata.cpp \
+    ../../vnacomand.cpp \
+    ../../vnasim/vnasimulator.cpp
+
+HEADERS += \
+    ../../scpiframer.h \
+    ../../scpiparser.h \
+    ../../sessioncapture.h \
+    ../../socket.h \
+    ../../socketmetrics.h \
+    ../../sweepfile.h \
+    ../../sweepframe.h \
+    ../../sweeprecorder.h \
+    ../../sweepring.h \
+    ../../tracedata.h \
+    ../../vnaclient.h \
+    ../../vnacomand.h \
+    ../../vnasim/vnasimulator.h
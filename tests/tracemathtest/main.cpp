@@ -0,0 +1,89 @@
+#include "tracemath.h"
+#include <QSignalSpy>
+#include <QTest>
+
+class TraceMathTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void storeWithoutMathThenSubtract();
+    void storeAppliesPerDevice();
+
+private:
+    static SweepFramePtr frame(quint64 sequence, const QVector<double>& re, const QVector<double>& im);
+    static SweepFramePtr runFrame(TraceMathEngine& engine, int deviceId, const SweepFramePtr& frame);
+};
+
+SweepFramePtr TraceMathTest::frame(quint64 sequence, const QVector<double>& re, const QVector<double>& im)
+{
+    auto out = std::make_shared<SweepFrame>();
+    out->sequence = sequence;
+    for (qsizetype i = 0; i < re.size(); ++i)
+        out->frequencyKHz.append(1000.0 * (i + 1));
+    out->traces.insert(1, ComplexTrace(re, im));
+    return out;
+}
+
+SweepFramePtr TraceMathTest::runFrame(TraceMathEngine& engine, int deviceId, const SweepFramePtr& frame)
+{
+    QSignalSpy spy(&engine, &TraceMathEngine::sweepProcessed);
+    engine.submit(deviceId, frame);
+    if (!spy.wait(5000)) return SweepFramePtr();
+    return engine.takeProcessed(deviceId);
+}
+
+void TraceMathTest::initTestCase()
+{
+    qRegisterMetaType<SweepFramePtr>("SweepFramePtr");
+}
+
+void TraceMathTest::storeWithoutMathThenSubtract()
+{
+    TraceMathEngine engine;
+    engine.startThread();
+    engine.setComplexTraces({1});
+
+    // без математики кадр проходит как есть
+    const SweepFramePtr first = frame(1, {1.0, 2.0, 3.0}, {0.5, 0.5, 0.5});
+    QCOMPARE(runFrame(engine, 0, first), first);
+
+    // «В память» при выключенной математике: запоминается следующий свип
+    engine.storeMemory();
+    QVERIFY(runFrame(engine, 0, frame(2, {1.0, 2.0, 3.0}, {0.5, 0.5, 0.5})));
+
+    TraceMathSettings settings;
+    settings.memory = TraceMemoryMath::Subtract;
+    engine.setSettings(settings);
+    const SweepFramePtr result = runFrame(engine, 0, frame(3, {4.0, 4.0, 4.0}, {1.0, 1.0, 1.0}));
+    QVERIFY(result);
+    const ComplexTrace trace = result->traces.value(1);
+    QCOMPARE(trace.real(), QVector<double>({3.0, 2.0, 1.0}));
+    QCOMPARE(trace.imag(), QVector<double>({0.5, 0.5, 0.5}));
+    engine.stopThread();
+}
+
+void TraceMathTest::storeAppliesPerDevice()
+{
+    TraceMathEngine engine;
+    engine.startThread();
+    engine.setComplexTraces({1});
+    QVERIFY(runFrame(engine, 0, frame(1, {1.0}, {0.0})));
+    QVERIFY(runFrame(engine, 1, frame(1, {1.0}, {0.0})));
+
+    // кадр одного прибора не снимает запрос с трасс другого
+    engine.storeMemory();
+    QVERIFY(runFrame(engine, 0, frame(2, {2.0}, {0.0})));
+    QVERIFY(runFrame(engine, 1, frame(2, {5.0}, {0.0})));
+
+    TraceMathSettings settings;
+    settings.memory = TraceMemoryMath::Subtract;
+    engine.setSettings(settings);
+    QCOMPARE(runFrame(engine, 0, frame(3, {3.0}, {0.0}))->traces.value(1).real(), QVector<double>({1.0}));
+    QCOMPARE(runFrame(engine, 1, frame(3, {9.0}, {0.0}))->traces.value(1).real(), QVector<double>({4.0}));
+    engine.stopThread();
+}
+
+QTEST_GUILESS_MAIN(TraceMathTest)
+#include "main.moc"
@@ -0,0 +1,19 @@
+QT = core testlib
+CONFIG += console c++17 testcase
+CONFIG -= app_bundle
+
+TARGET = tracemathtest
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../sweepring.cpp \
+    ../../tracedata.cpp \
+    ../../tracemath.cpp
+
+HEADERS += \
+    ../../sweepframe.h \
+    ../../sweepring.h \
+    ../../tracedata.h \
+    ../../tracemath.h
@@ -0,0 +1,85 @@
+#include "tracedata.h"
+#include <QtMath>
+#include <cmath>
+
+ComplexTrace::ComplexTrace(qsizetype points)
+    : _re(points)
+    , _im(points)
+{
+}
+
+ComplexTrace::ComplexTrace(const QVector<double>& re, const QVector<double>& im)
+    : _re(re)
+    , _im(im)
+{
+    if (_im.size() != _re.size()) _im.resize(_re.size());
+}
+
+void ComplexTrace::resize(qsizetype points)
+{
+    _re.resize(points);
+    _im.resize(points);
+}
+
+void ComplexTrace::append(const ComplexTrace& other)
+{
+    _re += other._re;
+    _im += other._im;
+}
+
+QVector<double> ComplexTrace::linearMagnitude() const
+{
+    const qsizetype n = size();
+    QVector<double> out(n);
+    const double* re = _re.constData();
+    const double* im = _im.constData();
+    double* dst = out.data();
+    for (qsizetype i = 0; i < n; ++i)
+        dst[i] = std::sqrt(re[i] * re[i] + im[i] * im[i]);
+    return out;
+}
+
+QVector<double> ComplexTrace::magnitudeDb() const
+{
+    const qsizetype n = size();
+    QVector<double> out(n);
+    const double* re = _re.constData();
+    const double* im = _im.constData();
+    double* dst = out.data();
+    // 20*log10(|z|) == 10*log10(|z|^2): без sqrt
+    for (qsizetype i = 0; i < n; ++i)
+        dst[i] = 10.0 * std::log10(re[i] * re[i] + im[i] * im[i]);
+    return out;
+}
+
+QVector<double> ComplexTrace::phaseDeg() const
+{
+    const qsizetype n = size();
+    QVector<double> out(n);
+    const double* re = _re.constData();
+    const double* im = _im.constData();
+    double* dst = out.data();
+    const double toDeg = 180.0 / M_PI;
+    for (qsizetype i = 0; i < n; ++i)
+        dst[i] = std::atan2(im[i], re[i]) * toDeg;
+    return out;
+}
+
+QVector<double> ComplexTrace::swr() const
+{
+    QVector<double> out = linearMagnitude();
+    double* dst = out.data();
+    for (qsizetype i = 0; i < out.size(); ++i) {
+        const double gamma = dst[i];
+        dst[i] = gamma < 1.0 ? (1.0 + gamma) / (1.0 - gamma) : INFINITY;
+    }
+    return out;
+}
+
+bool ComplexTrace::isComplexFormat(const QString& formatToken)
+{
+    const QString f = formatToken.toUpper();
+    return f.startsWith("SMIT") || f.startsWith("POL") || f.startsWith("SCOM")
+           || f.startsWith("SLIN") || f.startsWith("SLOG") || f.startsWith("SADM")
+           || f.startsWith("PLIN") || f.startsWith("PLOG");
+}
@@ -0,0 +1,41 @@
+#ifndef TRACEDATA_H
+#define TRACEDATA_H
+
+#include <QVector>
+#include <QString>
+
+// Комплексная трасса в виде структуры массивов: re и im лежат в отдельных
+// непрерывных буферах. QVector разделяется неявно, поэтому копия ComplexTrace
+// для графика, экспорта или математики не копирует сами данные.
+class ComplexTrace
+{
+public:
+    ComplexTrace() = default;
+    explicit ComplexTrace(qsizetype points);
+    ComplexTrace(const QVector<double>& re, const QVector<double>& im);
+
+    qsizetype size() const { return _re.size(); }
+    bool isEmpty() const { return _re.isEmpty(); }
+    void resize(qsizetype points);
+    // Дописать точки в конец: сборка свипа из сегментов
+    void append(const ComplexTrace& other);
+
+    const QVector<double>& real() const { return _re; }
+    const QVector<double>& imag() const { return _im; }
+    double* reData() { return _re.data(); }
+    double* imData() { return _im.data(); }
+
+    QVector<double> linearMagnitude() const;
+    QVector<double> magnitudeDb() const;
+    QVector<double> phaseDeg() const;
+    QVector<double> swr() const;
+
+    // Форматы CALC:FORM, в которых FDAT? отдаёт пару re,im, а не значение и ноль
+    static bool isComplexFormat(const QString& formatToken);
+
+private:
+    QVector<double> _re;
+    QVector<double> _im;
+};
+
+#endif // TRACEDATA_H
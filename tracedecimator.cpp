@@ -0,0 +1,44 @@
+#include "tracedecimator.h"
+#include <algorithm>
+
+void decimateMinMax(const qreal* x, const qreal* y, qsizetype count,
+                    qreal xMin, qreal xMax, int buckets, QList<QPointF>& out)
+{
+    out.clear();
+    if (count <= 0) return;
+
+    // Одна точка за границей диапазона с каждой стороны, чтобы линия доходила до края
+    qsizetype first = std::lower_bound(x, x + count, xMin) - x;
+    qsizetype last = std::upper_bound(x, x + count, xMax) - x;
+    if (first > 0) --first;
+    if (last < count) ++last;
+    const qsizetype visible = last - first;
+    if (visible <= 0) return;
+
+    if (buckets < 1 || visible <= 2 * qsizetype(buckets) || xMax <= xMin) {
+        out.resize(visible);
+        QPointF* dst = out.data();
+        for (qsizetype i = 0; i < visible; ++i)
+            dst[i] = QPointF(x[first + i], y[first + i]);
+        return;
+    }
+
+    out.reserve(2 * qsizetype(buckets) + 4);
+    const qreal scale = qreal(buckets) / (xMax - xMin);
+    qsizetype i = first;
+    while (i < last) {
+        const qsizetype bucket = qBound<qsizetype>(0, qsizetype((x[i] - xMin) * scale), buckets - 1);
+        qsizetype minIndex = i;
+        qsizetype maxIndex = i;
+        ++i;
+        while (i < last && qBound<qsizetype>(0, qsizetype((x[i] - xMin) * scale), buckets - 1) == bucket) {
+            if (y[i] < y[minIndex]) minIndex = i;
+            if (y[i] > y[maxIndex]) maxIndex = i;
+            ++i;
+        }
+        const qsizetype a = qMin(minIndex, maxIndex);
+        const qsizetype b = qMax(minIndex, maxIndex);
+        out.append(QPointF(x[a], y[a]));
+        if (b != a) out.append(QPointF(x[b], y[b]));
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef TRACEDECIMATOR_H
+#define TRACEDECIMATOR_H
+
+#include <QList>
+#include <QPointF>
+
+// Огибающая min/max по пикселям: видимый диапазон [xMin, xMax] делится на
+// buckets столбцов, из каждого в выходной список попадают только минимум и
+// максимум (в порядке следования по X). x должен быть неубывающим.
+// Если точек в диапазоне не больше 2*buckets, они копируются без прореживания.
+void decimateMinMax(const qreal* x, const qreal* y, qsizetype count,
+                    qreal xMin, qreal xMax, int buckets, QList<QPointF>& out);
+
+#endif // TRACEDECIMATOR_H
@@ -0,0 +1,323 @@
+#include "tracemath.h"
+#include <QDebug>
+#include <algorithm>
+
+#define TRACE_MATH_MAX_AVERAGE 999
+
+TraceMathEngine::TraceMathEngine(QObject* parent)
+    : QObject(parent)
+    , _thread(nullptr)
+{
+    _thread = new QThread();
+    this->moveToThread(_thread);
+}
+
+TraceMathEngine::~TraceMathEngine()
+{
+    stopThread();
+    delete _thread;
+    qDeleteAll(_channels);
+}
+
+void TraceMathEngine::startThread()
+{
+    if (_thread && !_thread->isRunning()) {
+        _thread->start();
+    }
+}
+
+void TraceMathEngine::stopThread()
+{
+    if (_thread && _thread->isRunning()) {
+        _thread->quit();
+        _thread->wait();
+    }
+}
+
+void TraceMathEngine::setSettings(const TraceMathSettings& settings)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, settings]() { setSettings(settings); }, Qt::QueuedConnection);
+        return;
+    }
+    TraceMathSettings next = settings;
+    next.averageCount = qBound(1, next.averageCount, TRACE_MATH_MAX_AVERAGE);
+    next.smoothPoints = qMax(0, next.smoothPoints);
+    const bool restart = next.average != _settings.average || next.averageCount != _settings.averageCount;
+    _settings = next;
+    if (restart) restartAveraging();
+}
+
+void TraceMathEngine::setComplexTraces(const QVector<int>& traces)
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this, traces]() { setComplexTraces(traces); }, Qt::QueuedConnection);
+        return;
+    }
+    _complexTraces = traces;
+}
+
+void TraceMathEngine::storeMemory()
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { storeMemory(); }, Qt::QueuedConnection);
+        return;
+    }
+    // без математики состояния трасс не заводятся — их создаст следующий кадр прибора
+    _storeDevices = _devices;
+    for (TraceState& state : _states)
+        state.storePending = true;
+}
+
+void TraceMathEngine::clearMemory()
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { clearMemory(); }, Qt::QueuedConnection);
+        return;
+    }
+    _storeDevices.clear();
+    for (TraceState& state : _states) {
+        state.memory = ComplexTrace();
+        state.storePending = false;
+    }
+}
+
+void TraceMathEngine::restartAveraging()
+{
+    if (QThread::currentThread() != _thread) {
+        QMetaObject::invokeMethod(this, [this]() { restartAveraging(); }, Qt::QueuedConnection);
+        return;
+    }
+    for (TraceState& state : _states) {
+        state.averaged = 0;
+        state.average = ComplexTrace();
+        state.window.clear();
+        state.windowHead = 0;
+    }
+}
+
+void TraceMathEngine::submit(int deviceId, SweepFramePtr frame)
+{
+    Channel*& channel = _channels[deviceId];
+    if (!channel) channel = new Channel();
+    // в очереди потока математики не больше одного вызова на прибор
+    if (!channel->input.publish(std::move(frame))) return;
+    Channel* target = channel;
+    QMetaObject::invokeMethod(this, [this, deviceId, target]() { processPending(deviceId, target); }, Qt::QueuedConnection);
+}
+
+SweepFramePtr TraceMathEngine::takeProcessed(int deviceId)
+{
+    Channel* channel = _channels.value(deviceId);
+    return channel ? channel->output.take() : SweepFramePtr();
+}
+
+void TraceMathEngine::processPending(int deviceId, Channel* channel)
+{
+    const SweepFramePtr frame = channel->input.take();
+    if (!frame) return;
+    if (channel->output.publish(process(deviceId, frame))) emit sweepProcessed(deviceId);
+}
+
+bool TraceMathEngine::storePending(int deviceId, const SweepFrame& frame) const
+{
+    if (_storeDevices.contains(deviceId)) return true;
+    for (auto it = frame.traces.constBegin(); it != frame.traces.constEnd(); ++it) {
+        if (_states.value(stateKey(deviceId, it.key())).storePending) return true;
+    }
+    return false;
+}
+
+SweepFramePtr TraceMathEngine::process(int deviceId, const SweepFramePtr& frame)
+{
+    _devices.insert(deviceId);
+    if (_settings.isIdentity() && !storePending(deviceId, *frame)) {
+        // без математики кадр уходит как есть, без копий
+        return frame;
+    }
+    auto out = std::make_shared<SweepFrame>();
+    out->sequence = frame->sequence;
+    out->startedMs = frame->startedMs;
+    out->completedMs = frame->completedMs;
+    out->settings = frame->settings;
+    out->frequencyKHz = frame->frequencyKHz;
+    out->refreshedTraces = frame->refreshedTraces;
+    // флаг прибора переходит на его трассы: память запишется при их перечитывании
+    const bool storeDevice = _storeDevices.remove(deviceId);
+    for (auto it = frame->traces.constBegin(); it != frame->traces.constEnd(); ++it) {
+        const int tr = it.key();
+        TraceState& state = _states[stateKey(deviceId, tr)];
+        if (storeDevice) state.storePending = true;
+        const bool refreshed = frame->refreshedTraces.isEmpty() || frame->refreshedTraces.contains(tr);
+        if (!refreshed && state.output.size() == it.value().size()) {
+            // повтор прошлых данных в среднее не идёт
+            out->traces.insert(tr, state.output);
+            continue;
+        }
+        state.output = processTrace(state, it.value(), _complexTraces.contains(tr));
+        out->traces.insert(tr, state.output);
+    }
+    return SweepFramePtr(std::move(out));
+}
+
+// Скользящее среднее по окну 2*half+1 через префиксные суммы: середина —
+// один проход без ветвлений при любом окне, у краёв окно укорачивается.
+static void movingAverage(const double* in, double* out, qsizetype n, qsizetype half, QVector<double>& prefix)
+{
+    prefix.resize(n + 1);
+    double* p = prefix.data();
+    p[0] = 0.0;
+    for (qsizetype i = 0; i < n; ++i)
+        p[i + 1] = p[i] + in[i];
+
+    const qsizetype edge = qMin(half, n);
+    for (qsizetype i = 0; i < edge; ++i) {
+        const qsizetype hi = qMin(n, i + half + 1);
+        out[i] = p[hi] / double(hi);
+    }
+    const double scale = 1.0 / double(2 * half + 1);
+    for (qsizetype i = edge; i < n - half; ++i)
+        out[i] = (p[i + half + 1] - p[i - half]) * scale;
+    for (qsizetype i = qMax(edge, n - half); i < n; ++i) {
+        const qsizetype lo = qMax<qsizetype>(0, i - half);
+        out[i] = (p[n] - p[lo]) / double(n - lo);
+    }
+}
+
+ComplexTrace TraceMathEngine::processTrace(TraceState& state, const ComplexTrace& data, bool complexData)
+{
+    const qsizetype n = data.size();
+    if (state.points != n) {
+        // другое число точек: среднее и память к этим данным не относятся
+        const bool storePending = state.storePending;
+        state = TraceState();
+        state.points = n;
+        state.storePending = storePending;
+    }
+
+    ComplexTrace result = _settings.average == TraceAverage::Off ? data : averageTrace(state, data);
+    if (state.storePending) {
+        state.memory = result;
+        state.storePending = false;
+    }
+
+    if (_settings.memory != TraceMemoryMath::Off && state.memory.size() == n) {
+        ComplexTrace math(n);
+        const double* dr = result.real().constData();
+        const double* di = result.imag().constData();
+        const double* mr = state.memory.real().constData();
+        const double* mi = state.memory.imag().constData();
+        double* outRe = math.reData();
+        double* outIm = math.imData();
+        if (_settings.memory == TraceMemoryMath::Subtract) {
+            for (qsizetype i = 0; i < n; ++i) {
+                outRe[i] = dr[i] - mr[i];
+                outIm[i] = di[i] - mi[i];
+            }
+        } else {
+            for (qsizetype i = 0; i < n; ++i) {
+                const double inv = 1.0 / (mr[i] * mr[i] + mi[i] * mi[i]);
+                outRe[i] = (dr[i] * mr[i] + di[i] * mi[i]) * inv;
+                outIm[i] = (di[i] * mr[i] - dr[i] * mi[i]) * inv;
+            }
+        }
+        result = math;
+    }
+
+    // в скалярных форматах прибор уже прислал дБ/фазу, второй раз не пересчитываются
+    if (complexData) {
+        switch (_settings.output) {
+        case TraceOutput::AsMeasured: break;
+        case TraceOutput::MagnitudeDb: result = ComplexTrace(result.magnitudeDb(), QVector<double>()); break;
+        case TraceOutput::LinearMagnitude: result = ComplexTrace(result.linearMagnitude(), QVector<double>()); break;
+        case TraceOutput::PhaseDeg: result = ComplexTrace(result.phaseDeg(), QVector<double>()); break;
+        }
+    }
+
+    const qsizetype half = qMin<qsizetype>(_settings.smoothPoints / 2, n / 2);
+    if (half > 0) {
+        ComplexTrace smoothed(n);
+        QVector<double> prefix;
+        movingAverage(result.real().constData(), smoothed.reData(), n, half, prefix);
+        movingAverage(result.imag().constData(), smoothed.imData(), n, half, prefix);
+        result = smoothed;
+    }
+    return result;
+}
+
+ComplexTrace TraceMathEngine::averageTrace(TraceState& state, const ComplexTrace& data)
+{
+    const qsizetype n = data.size();
+    const int count = _settings.averageCount;
+    const double* dr = data.real().constData();
+    const double* di = data.imag().constData();
+
+    if (_settings.average == TraceAverage::Exponential) {
+        if (state.averaged == 0) {
+            state.average = data;
+            state.averaged = 1;
+            return state.average;
+        }
+        state.averaged = qMin(state.averaged + 1, count);
+        // до N свипов — точное среднее, дальше — экспоненциальное с весом 1/N
+        const double weight = 1.0 / state.averaged;
+        double* ar = state.average.reData();
+        double* ai = state.average.imData();
+        for (qsizetype i = 0; i < n; ++i) {
+            ar[i] += (dr[i] - ar[i]) * weight;
+            ai[i] += (di[i] - ai[i]) * weight;
+        }
+        return state.average;
+    }
+
+    // Boxcar: в state.average — сумма окна; вышедший свип вычитается, новый прибавляется
+    if (state.window.size() != count) {
+        state.window = QVector<ComplexTrace>(count);
+        state.windowHead = 0;
+        state.averaged = 0;
+        state.average = ComplexTrace(n);
+    }
+    ComplexTrace& slot = state.window[state.windowHead];
+    double* sr = state.average.reData();
+    double* si = state.average.imData();
+    if (slot.size() == n) {
+        const double* oldRe = slot.real().constData();
+        const double* oldIm = slot.imag().constData();
+        for (qsizetype i = 0; i < n; ++i) {
+            sr[i] += dr[i] - oldRe[i];
+            si[i] += di[i] - oldIm[i];
+        }
+    } else {
+        for (qsizetype i = 0; i < n; ++i) {
+            sr[i] += dr[i];
+            si[i] += di[i];
+        }
+    }
+    slot = data;
+    state.windowHead = (state.windowHead + 1) % count;
+    state.averaged = qMin(state.averaged + 1, count);
+    if (state.windowHead == 0) {
+        // раз в окно сумма пересчитывается заново, чтобы ошибка округления не копилась
+        std::fill(sr, sr + n, 0.0);
+        std::fill(si, si + n, 0.0);
+        for (const ComplexTrace& sweep : state.window) {
+            if (sweep.size() != n) continue;
+            const double* wr = sweep.real().constData();
+            const double* wi = sweep.imag().constData();
+            for (qsizetype i = 0; i < n; ++i) {
+                sr[i] += wr[i];
+                si[i] += wi[i];
+            }
+        }
+    }
+
+    ComplexTrace mean(n);
+    const double scale = 1.0 / state.averaged;
+    double* outRe = mean.reData();
+    double* outIm = mean.imData();
+    for (qsizetype i = 0; i < n; ++i) {
+        outRe[i] = sr[i] * scale;
+        outIm[i] = si[i] * scale;
+    }
+    return mean;
+}
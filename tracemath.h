@@ -0,0 +1,121 @@
+#ifndef TRACEMATH_H
+#define TRACEMATH_H
+
+#include "sweepframe.h"
+#include "sweepring.h"
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+
+enum class TraceAverage
+{
+    Off,
+    Exponential,    // как усреднение свипов прибора: накопление до N, затем вес 1/N
+    Boxcar          // среднее последних N свипов
+};
+
+enum class TraceMemoryMath
+{
+    Off,
+    Subtract,       // данные − память; для трасс в дБ — это и есть нормировка
+    Divide          // данные / память, комплексное деление
+};
+
+enum class TraceOutput
+{
+    AsMeasured,
+    MagnitudeDb,    // преобразования — только для трасс в комплексных форматах
+    LinearMagnitude,
+    PhaseDeg
+};
+
+struct TraceMathSettings
+{
+    TraceAverage average = TraceAverage::Off;
+    int averageCount = 16;
+    TraceMemoryMath memory = TraceMemoryMath::Off;
+    TraceOutput output = TraceOutput::AsMeasured;
+    int smoothPoints = 0;           // окно сглаживания по точкам, 0 и 1 — без сглаживания
+
+    bool isIdentity() const
+    {
+        return average == TraceAverage::Off && memory == TraceMemoryMath::Off
+               && output == TraceOutput::AsMeasured && smoothPoints <= 1;
+    }
+};
+
+// Математика трасс на стороне клиента в отдельном потоке. Порядок как у
+// прибора: усреднение и память — над данными в виде re/im, затем
+// преобразование формата и сглаживание. Все проходы — плоские циклы по
+// непрерывным массивам ComplexTrace, без ветвлений внутри.
+class TraceMathEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TraceMathEngine(QObject* parent = nullptr);
+    ~TraceMathEngine();
+
+    void startThread();
+    void stopThread();
+
+    // Методы ниже можно вызывать из любого потока
+    void setSettings(const TraceMathSettings& settings);
+    // Трассы, для которых FDAT? отдаёт пару re,im: только их можно преобразовать в дБ/фазу
+    void setComplexTraces(const QVector<int>& traces);
+    // Следующий перечитанный свип каждой трассы приборов, уже присылавших
+    // данные, запоминается (после усреднения) как память
+    void storeMemory();
+    void clearMemory();
+    // Усреднение начинается заново
+    void restartAveraging();
+
+    // submit() и takeProcessed() — из одного потока (GUI). Побеждает последний
+    // свип: пока поток математики занят, новый кадр прибора вытесняет ждущий
+    void submit(int deviceId, SweepFramePtr frame);
+    // nullptr — нового результата нет
+    SweepFramePtr takeProcessed(int deviceId);
+
+signals:
+    // Есть результат для takeProcessed(); пока он не забран, повторно не приходит
+    void sweepProcessed(int deviceId);
+
+private:
+    struct TraceState
+    {
+        qsizetype points = 0;
+        int averaged = 0;               // свипов в среднем, не больше averageCount
+        ComplexTrace average;           // экспоненциальное: текущее среднее, boxcar: сумма окна
+        QVector<ComplexTrace> window;   // boxcar: последние averageCount свипов
+        int windowHead = 0;
+        ComplexTrace memory;
+        ComplexTrace output;            // для свипов, в которых трасса не перечитывалась
+        bool storePending = false;      // storeMemory(): ждём перечитанных данных
+    };
+
+    // Кадры одного прибора: в поток математики и обратно
+    struct Channel
+    {
+        SweepMailbox input;
+        SweepMailbox output;
+    };
+
+    void processPending(int deviceId, Channel* channel);
+    SweepFramePtr process(int deviceId, const SweepFramePtr& frame);
+    bool storePending(int deviceId, const SweepFrame& frame) const;
+    ComplexTrace processTrace(TraceState& state, const ComplexTrace& data, bool complexData);
+    ComplexTrace averageTrace(TraceState& state, const ComplexTrace& data);
+    static quint64 stateKey(int deviceId, int trace) { return (quint64(quint32(deviceId)) << 32) | quint32(trace); }
+
+    QThread* _thread;
+    TraceMathSettings _settings;
+    QVector<int> _complexTraces;
+    QHash<quint64, TraceState> _states;
+    QSet<int> _devices;                 // приборы, чьи кадры уже приходили
+    QSet<int> _storeDevices;            // storeMemory(): у трасс этих приборов может ещё не быть состояния
+    QHash<int, Channel*> _channels;     // только поток submit(); каналы живут до деструктора
+};
+
+#endif // TRACEMATH_H
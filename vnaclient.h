@@ -5,7 +5,10 @@
 #include <QHostAddress>
 #include <QVector>
 #include <QString>
+#include <QByteArray>
 #include "vnacomand.h"
+#include "sweepframe.h"
+#include "sweepring.h"
 
 class VNAclient : public QObject {
     Q_OBJECT
@@ -15,16 +18,40 @@ public:
     virtual ~VNAclient() = default;
     virtual VNAclient* getInstance() = 0;
 
+    // Последний готовый свип, из потока получателя sweepReady(). Свип, который
+    // не успели забрать, вытесняется следующим: очередь событий не растёт
+    SweepFramePtr takeSweep() { return _display.take(); }
+    quint64 sweepsSuperseded() const { return _display.superseded(); }
+
 public slots:
     virtual void startScan(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz) = 0;
     virtual void stopScan() = 0;
-    virtual void sendCommand(const QHostAddress &host, quint16 port, const QVector<VNAcomand*> &commands) = 0;
+    virtual void sendCommand(const QHostAddress &host, quint16 port, const QVector<ScpiCommand> &commands) = 0;
     virtual void setGraphSettings(int graphCount, const QVector<int>& traceNumbers) = 0;
 signals:
     void connected();
     void disconnected();
     void error(int errorCode, const QString &message);
-    void dataFromVNA(const QString &data, VNAcomand *cmd);
+    void dataFromVNA(const QByteArray &data, const ScpiCommand &cmd);
+    // Есть новый свип для takeSweep(); пока он не забран, повторно не приходит
+    void sweepReady();
+    // Часть сегментированного свипа: точки с firstPoint из totalPoints.
+    // Полный кадр после последнего сегмента всё равно приходит в sweepReady
+    void sweepSegmentReady(SweepFramePtr segment, int firstPoint, int totalPoints);
+    // Свип закончился без данных (ошибка чтения), следующий идёт как обычно
+    void sweepAborted();
+
+protected:
+    // Поток, собирающий свипы. false — предыдущий свип так и не забрали
+    bool publishSweep(SweepFramePtr frame)
+    {
+        if (!_display.publish(std::move(frame))) return false;
+        emit sweepReady();
+        return true;
+    }
+
+private:
+    SweepMailbox _display;
 };
 
 #endif // VNACLIENT_H
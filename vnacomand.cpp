@@ -1,45 +1,159 @@
 #include "vnacomand.h"
-#include <QStringList>
+#include "scpiparser.h"
+#include <QtEndian>
+#include <cstring>
+#include <type_traits>
 
-static QVector<qreal> parseCsvToReals(const QString& data)
+static_assert(std::is_same<qreal, double>::value, "trace parsers write qreal buffers as double");
+
+bool scpiBlockHeader(const QByteArray& data, qsizetype& headerLength, qsizetype& payloadLength)
+{
+    if (data.size() < 2 || data.at(0) != '#') return false;
+    const char digitsChar = data.at(1);
+    if (digitsChar < '0' || digitsChar > '9') return false;
+    const int digits = digitsChar - '0';
+    if (digits == 0) {
+        // блок неопределённой длины: данные идут до конца ответа
+        headerLength = 2;
+        payloadLength = data.size() - 2 - (data.endsWith('\n') ? 1 : 0);
+        return true;
+    }
+    if (data.size() < 2 + digits) return false;
+    qsizetype length = 0;
+    for (int i = 0; i < digits; ++i) {
+        const char c = data.at(2 + i);
+        if (c < '0' || c > '9') return false;
+        length = length * 10 + (c - '0');
+    }
+    headerLength = 2 + digits;
+    payloadLength = length;
+    return true;
+}
+
+template <typename Real, typename Raw>
+static QVector<qreal> decodeBlock(const char* payload, qsizetype length, bool littleEndian, int stride)
 {
-    QVector<qreal> out;
-    QStringList parts = data.trimmed().split(',', Qt::SkipEmptyParts);
-    out.reserve(parts.size());
-    for (const QString& p : parts) {
-        bool ok = false;
-        double v = p.toDouble(&ok);
-        if (ok) out.append((qreal)v);
+    const qsizetype total = length / qsizetype(sizeof(Raw));
+    QVector<qreal> out((total + stride - 1) / stride);
+    for (qsizetype i = 0, j = 0; i < total; i += stride, ++j) {
+        const char* p = payload + i * qsizetype(sizeof(Raw));
+        const Raw raw = littleEndian ? qFromLittleEndian<Raw>(p) : qFromBigEndian<Raw>(p);
+        Real v;
+        std::memcpy(&v, &raw, sizeof(v));
+        out[j] = (qreal)v;
     }
     return out;
 }
 
-QVector<qreal> CALC_TRACE_DATA_FDAT::parseResponse(const QString& data) const
+QVector<qreal> parseTraceReals(const QByteArray& data, TraceDataFormat dataFormat, bool littleEndian, int stride)
 {
-    QVector<qreal> all = parseCsvToReals(data);
-    QVector<qreal> out;
-    out.reserve((all.size()+1)/2);
-    for (int i = 0; i < all.size(); i += 2)
-        out.append(all[i]);
+    qsizetype headerLength = 0;
+    qsizetype payloadLength = 0;
+    if (dataFormat == TraceDataFormat::Ascii || !scpiBlockHeader(data, headerLength, payloadLength)) {
+        const char* begin = data.constData();
+        const char* end = begin + data.size();
+        QVector<qreal> out((scpiValueCount(begin, end) + stride - 1) / stride);
+        out.resize(parseScpiReals(begin, end, out.data(), out.size(), stride, 0));
+        return out;
+    }
+    payloadLength = qMin(payloadLength, data.size() - headerLength);
+    const char* payload = data.constData() + headerLength;
+    if (dataFormat == TraceDataFormat::Real32)
+        return decodeBlock<float, quint32>(payload, payloadLength, littleEndian, stride);
+    return decodeBlock<double, quint64>(payload, payloadLength, littleEndian, stride);
+}
+
+template <typename Real, typename Raw>
+static void decodeComplexBlock(const char* payload, qsizetype length, bool littleEndian, ComplexTrace& out)
+{
+    const qsizetype points = length / qsizetype(2 * sizeof(Raw));
+    out.resize(points);
+    double* re = out.reData();
+    double* im = out.imData();
+    for (qsizetype i = 0; i < points; ++i) {
+        const char* p = payload + i * qsizetype(2 * sizeof(Raw));
+        const Raw rawRe = littleEndian ? qFromLittleEndian<Raw>(p) : qFromBigEndian<Raw>(p);
+        const Raw rawIm = littleEndian ? qFromLittleEndian<Raw>(p + sizeof(Raw)) : qFromBigEndian<Raw>(p + sizeof(Raw));
+        Real vRe;
+        Real vIm;
+        std::memcpy(&vRe, &rawRe, sizeof(vRe));
+        std::memcpy(&vIm, &rawIm, sizeof(vIm));
+        re[i] = vRe;
+        im[i] = vIm;
+    }
+}
+
+ComplexTrace parseTraceComplex(const QByteArray& data, TraceDataFormat dataFormat, bool littleEndian)
+{
+    ComplexTrace out;
+    qsizetype headerLength = 0;
+    qsizetype payloadLength = 0;
+    if (dataFormat == TraceDataFormat::Ascii || !scpiBlockHeader(data, headerLength, payloadLength)) {
+        const char* begin = data.constData();
+        const char* end = begin + data.size();
+        out.resize((scpiValueCount(begin, end) + 1) / 2);
+        out.resize(parseScpiComplex(begin, end, out.reData(), out.imData(), out.size()));
+        return out;
+    }
+    payloadLength = qMin(payloadLength, data.size() - headerLength);
+    const char* payload = data.constData() + headerLength;
+    if (dataFormat == TraceDataFormat::Real32) {
+        decodeComplexBlock<float, quint32>(payload, payloadLength, littleEndian, out);
+    } else {
+        decodeComplexBlock<double, quint64>(payload, payloadLength, littleEndian, out);
+    }
     return out;
 }
 
-QVector<qreal> CALC_TRACE_DATA_XAXIS::parseResponse(const QString& data) const
+QVector<qreal> parseFrequencyKHz(const QByteArray& data, TraceDataFormat format, bool littleEndian)
 {
-    QVector<qreal> values = parseCsvToReals(data);
+    QVector<qreal> values = parseTraceReals(data, format, littleEndian);
     for (int i = 0; i < values.size(); ++i) {
         values[i] = values[i] / 1000.0;
     }
     return values;
 }
 
-QVector<qreal> CALC_TRACE_DATA_POWER::parseResponse(const QString& data) const
+ScpiReplyParser<ReplyKind::Scalar>::Value ScpiReplyParser<ReplyKind::Scalar>::parse(const QByteArray& data, TraceDataFormat, bool)
+{
+    double value = 0.0;
+    parseScpiReals(data.constData(), data.constData() + data.size(), &value, 1);
+    return value;
+}
+
+ScpiReplyParser<ReplyKind::Block>::Value ScpiReplyParser<ReplyKind::Block>::parse(const QByteArray& data, TraceDataFormat, bool)
+{
+    qsizetype headerLength = 0;
+    qsizetype payloadLength = 0;
+    if (!scpiBlockHeader(data, headerLength, payloadLength)) return data;
+    return data.mid(headerLength, qMin(payloadLength, data.size() - headerLength));
+}
+
+ScpiCommand ScpiCommand::raw(const QByteArray& line, ReplyKind reply)
 {
-    QVector<qreal> all = parseCsvToReals(data);
-    QVector<qreal> out;
-    out.reserve((all.size()+1)/2);
-    for (int i = 0; i < all.size(); i += 2) {
-        out.append(all[i]);
+    ScpiCommand command;
+    command.scpi = line;
+    command.reply = reply;
+    command.finish();
+    return command;
+}
+
+void ScpiCommand::finish()
+{
+    while (scpi.endsWith('\n') || scpi.endsWith('\r'))
+        scpi.chop(1);
+    qsizetype end = 0;
+    while (end < scpi.size() && scpi.at(end) != ' ')
+        ++end;
+    header = scpi.left(end);
+}
+
+const char* formatDataToken(TraceDataFormat format)
+{
+    switch (format) {
+    case TraceDataFormat::Real32: return "REAL32";
+    case TraceDataFormat::Real64: return "REAL";
+    case TraceDataFormat::Ascii: break;
     }
-    return out;
+    return "ASCii";
 }
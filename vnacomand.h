@@ -2,259 +2,267 @@
 #define VNACOMAND_H
 
 #include <QString>
+#include <QByteArray>
+#include <QMetaType>
 #include <QVector>
+#include <charconv>
+#include <cstddef>
+#include "tracedata.h"
+
+enum class TraceDataFormat
+{
+    Ascii,
+    Real64,
+    Real32
+};
+
+bool scpiBlockHeader(const QByteArray& data, qsizetype& headerLength, qsizetype& payloadLength);
+
+// Разбор ответов FDAT?/XAXIS? без объекта команды
+QVector<qreal> parseTraceReals(const QByteArray& data, TraceDataFormat format, bool littleEndian, int stride = 1);
+ComplexTrace parseTraceComplex(const QByteArray& data, TraceDataFormat format, bool littleEndian);
+QVector<qreal> parseFrequencyKHz(const QByteArray& data, TraceDataFormat format, bool littleEndian);
+
+// Что прибор возвращает в ответ на команду
+enum class ReplyKind : quint8
+{
+    None,           // команда без ответа
+    Scalar,         // одно число (*OPC?, счётчики)
+    RealArray,      // "v0,v1,..." или двоичный блок действительных чисел
+    ComplexArray,   // пары re,im
+    Block,          // произвольный блок #n..., отдаётся как есть
+    Text            // строка ответа без завершающих пробелов
+};
+
+enum class ScpiId : quint8
+{
+    Raw,                    // строка, собранная вызывающим (ScpiCommand::raw)
+    SystemPreset,
+    FormatData,
+    FormatBorder,
+    SourcePowerLevel,
+    SourcePowerSpan,
+    FreqStart,
+    FreqStop,
+    FreqFixed,
+    FreqCw,
+    FreqCenter,
+    SweepPoints,
+    Bandwidth,
+    SweepType,
+    TriggerSourceBus,
+    TriggerSingle,
+    InitContinuous,
+    Abort,
+    OperationComplete,
+    StatusEnableEcho,
+    ParameterCount,
+    ParameterDefine,
+    ParameterSelect,
+    ParameterSourcePort,
+    TraceFormat,
+    DisplayTraceActivate,
+    OutputState,
+    TraceXAxis,
+    TraceData,
+    Count
+};
+
+// Строка таблицы: шаблон SCPI, где каждое {} — очередной аргумент makeScpi<>(),
+// вид ответа, номер аргумента, который является номером трассы (-1 — нет), и
+// признак настройки: значение остаётся на приборе и читается запросом "<заголовок>?".
+struct ScpiSpec
+{
+    ScpiId id;
+    const char* pattern;
+    ReplyKind reply;
+    int traceArg;
+    bool state;
+};
+
+// Новая команда — одна строка здесь и значение в ScpiId
+inline constexpr ScpiSpec kScpiTable[] = {
+    {ScpiId::Raw,                  "",                                             ReplyKind::None,         -1, false},
+    {ScpiId::SystemPreset,         "SYST:PRESet",                                  ReplyKind::None,         -1, false},
+    {ScpiId::FormatData,           "FORM:DATA {}",                                 ReplyKind::None,         -1, true},
+    {ScpiId::FormatBorder,         "FORM:BORD {}",                                 ReplyKind::None,         -1, true},
+    {ScpiId::SourcePowerLevel,     "SOURce{}:POWer:LEVel:IMMediate:AMPLitude {}",  ReplyKind::None,         -1, true},
+    {ScpiId::SourcePowerSpan,      "SOURce{}:POWer:SPAN {}",                       ReplyKind::None,         -1, true},
+    {ScpiId::FreqStart,            "SENS:FREQ:STAR {}",                            ReplyKind::None,         -1, true},
+    {ScpiId::FreqStop,             "SENS:FREQ:STOP {}",                            ReplyKind::None,         -1, true},
+    {ScpiId::FreqFixed,            "SENS:FREQ:FIXed {}",                           ReplyKind::None,         -1, true},
+    {ScpiId::FreqCw,               "SENS:FREQ:CW {}",                              ReplyKind::None,         -1, true},
+    {ScpiId::FreqCenter,           "SENS:FREQ:CENT {}",                            ReplyKind::None,         -1, true},
+    {ScpiId::SweepPoints,          "SENS:SWE:POIN {}",                             ReplyKind::None,         -1, true},
+    {ScpiId::Bandwidth,            "SENS:BAND {}",                                 ReplyKind::None,         -1, true},
+    {ScpiId::SweepType,            "SENSe{}:SWEep:TYPE {}",                        ReplyKind::None,         -1, true},
+    {ScpiId::TriggerSourceBus,     "TRIGger:SEQuence:SOURce BUS",                  ReplyKind::None,         -1, true},
+    {ScpiId::TriggerSingle,        "TRIG:SING",                                    ReplyKind::None,         -1, false},
+    {ScpiId::InitContinuous,       "INITiate{}:CONTinuous {}",                     ReplyKind::None,         -1, true},
+    {ScpiId::Abort,                ":ABOR",                                        ReplyKind::None,         -1, false},
+    {ScpiId::OperationComplete,    "*OPC?",                                        ReplyKind::Scalar,       -1, false},
+    {ScpiId::StatusEnableEcho,     "*ESE {};*ESE?",                                ReplyKind::Scalar,       -1, false},
+    {ScpiId::ParameterCount,       "CALC1:PAR:COUN {}",                            ReplyKind::None,         -1, true},
+    {ScpiId::ParameterDefine,      "CALC1:PAR{}:DEF {}",                           ReplyKind::None,          0, true},
+    {ScpiId::ParameterSelect,      "CALC1:PAR{}:SEL",                              ReplyKind::None,          0, false},
+    {ScpiId::ParameterSourcePort,  "CALC1:PAR{}:SPOR {}",                          ReplyKind::None,          0, true},
+    {ScpiId::TraceFormat,          "CALC1:TRAC{}:FORM {}",                         ReplyKind::None,          0, true},
+    {ScpiId::DisplayTraceActivate, "DISP:WIND{}:TRAC{}:ACT",                       ReplyKind::None,          1, false},
+    {ScpiId::OutputState,          "OUTPut{}:STATe {}",                            ReplyKind::None,         -1, true},
+    {ScpiId::TraceXAxis,           "CALC:TRAC{}:DATA:XAXIS?",                      ReplyKind::RealArray,     0, false},
+    {ScpiId::TraceData,            "CALC:TRAC{}:DATA:FDAT?",                       ReplyKind::ComplexArray,  0, false},
+};
+
+constexpr bool scpiTableMatchesIds()
+{
+    for (std::size_t i = 0; i < sizeof(kScpiTable) / sizeof(kScpiTable[0]); ++i) {
+        if (std::size_t(kScpiTable[i].id) != i) return false;
+    }
+    return sizeof(kScpiTable) / sizeof(kScpiTable[0]) == std::size_t(ScpiId::Count);
+}
+static_assert(scpiTableMatchesIds(), "kScpiTable rows must follow the order of ScpiId");
+
+constexpr const ScpiSpec& scpiSpec(ScpiId id) { return kScpiTable[std::size_t(id)]; }
+
+// Готовая к отправке команда: строка SCPI и заголовок собираются один раз,
+// дальше ScpiCommand передаётся по значению — QByteArray разделяется неявно,
+// поэтому повторная отправка не выделяет память и не собирает строк.
+struct ScpiCommand
+{
+    QByteArray scpi;        // без завершающего перевода строки
+    QByteArray header;      // до первого пробела
+    ScpiId id = ScpiId::Raw;
+    ReplyKind reply = ReplyKind::None;
+    int trace = 0;
+    // формат передачи на момент ответа: Socket заполняет перед dataFromVNA
+    TraceDataFormat dataFormat = TraceDataFormat::Ascii;
+    bool littleEndian = false;
+
+    bool isNull() const { return scpi.isEmpty(); }
+    bool isQuery() const { return reply != ReplyKind::None; }
+    bool isSetting() const { return scpiSpec(id).state; }
+
+    static ScpiCommand raw(const QByteArray& line, ReplyKind reply = ReplyKind::None);
+    void finish();
+};
+
+Q_DECLARE_METATYPE(ScpiCommand)
+
+namespace scpi_detail {
+
+constexpr int placeholderCount(const char* pattern)
+{
+    int count = 0;
+    for (; *pattern; ++pattern) {
+        if (pattern[0] == '{' && pattern[1] == '}') ++count;
+    }
+    return count;
+}
+
+template <typename Int>
+inline void appendInteger(QByteArray& out, Int value)
+{
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, int(result.ptr - buffer));
+}
+
+inline void appendArg(QByteArray& out, int value) { appendInteger(out, value); }
+inline void appendArg(QByteArray& out, qint64 value) { appendInteger(out, value); }
+inline void appendArg(QByteArray& out, bool value) { out.append(value ? "ON" : "OFF"); }
+inline void appendArg(QByteArray& out, const char* token) { out.append(token); }
+inline void appendArg(QByteArray& out, const QByteArray& token) { out.append(token); }
+inline void appendArg(QByteArray& out, const QString& token) { out.append(token.toLatin1()); }
+inline void appendArg(QByteArray& out, double value)
+{
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, int(result.ptr - buffer));
+}
+
+template <typename T> inline int traceValue(const T&) { return 0; }
+inline int traceValue(int value) { return value; }
+
+} // namespace scpi_detail
+
+// Команда по строке таблицы; число и порядок аргументов проверяются при компиляции
+template <ScpiId Id, typename... Args>
+ScpiCommand makeScpi(const Args&... args)
+{
+    constexpr const ScpiSpec& spec = scpiSpec(Id);
+    static_assert(Id != ScpiId::Raw && Id != ScpiId::Count, "use ScpiCommand::raw for ad-hoc commands");
+    static_assert(scpi_detail::placeholderCount(spec.pattern) == int(sizeof...(Args)),
+                  "argument count does not match the SCPI pattern");
+    ScpiCommand command;
+    command.id = Id;
+    command.reply = spec.reply;
+    const char* pattern = spec.pattern;
+    int index = 0;
+    const auto appendNext = [&](const auto& arg) {
+        const char* placeholder = pattern;
+        while (placeholder[0] != '{' || placeholder[1] != '}')
+            ++placeholder;
+        command.scpi.append(pattern, int(placeholder - pattern));
+        scpi_detail::appendArg(command.scpi, arg);
+        if (index == spec.traceArg) command.trace = scpi_detail::traceValue(arg);
+        pattern = placeholder + 2;
+        ++index;
+    };
+    (appendNext(args), ...);
+    (void)appendNext;   // команды без аргументов
+    command.scpi.append(pattern);
+    command.finish();
+    return command;
+}
 
-class VNAcomand
-{
-public:
-    bool request;
-    int type;
-    QString SCPI;
-
-    VNAcomand(bool request_ = false, int type_ = 0, const QString& scpi = QString())
-        : request(request_), type(type_), SCPI(scpi) {}
-    virtual ~VNAcomand() = default;
-};
+// Разбор ответа выбирается по виду ответа при компиляции, без виртуальных вызовов
+template <ReplyKind Kind> struct ScpiReplyParser;
 
-class VNAcomand_REAL : public VNAcomand
+template <> struct ScpiReplyParser<ReplyKind::Scalar>
 {
-public:
-    VNAcomand_REAL(bool request_, int type_, const QString& scpi = QString())
-        : VNAcomand(request_, type_, scpi) {}
-    virtual ~VNAcomand_REAL() = default;
-    virtual QVector<qreal> parseResponse(const QString& data) const = 0;
+    using Value = double;
+    static Value parse(const QByteArray& data, TraceDataFormat format, bool littleEndian);
 };
 
-class CALC_TRACE_DATA_FDAT : public VNAcomand_REAL
+template <> struct ScpiReplyParser<ReplyKind::RealArray>
 {
-public:
-    CALC_TRACE_DATA_FDAT(int traceNum)
-        : VNAcomand_REAL(true, traceNum,
-                         QString("CALC:TRAC%1:DATA:FDAT?\n").arg(traceNum)) {}
-    QVector<qreal> parseResponse(const QString& data) const override;
+    using Value = QVector<qreal>;
+    static Value parse(const QByteArray& data, TraceDataFormat format, bool littleEndian)
+    {
+        return parseTraceReals(data, format, littleEndian);
+    }
 };
 
-class SENS_FREQ_START : public VNAcomand_REAL
+template <> struct ScpiReplyParser<ReplyKind::ComplexArray>
 {
-public:
-    SENS_FREQ_START(int type, qint64 freqHz)
-        : VNAcomand_REAL(false, type, QString("SENS:FREQ:STAR %1\n").arg(freqHz)) {}
-    QVector<qreal> parseResponse(const QString& data) const override { Q_UNUSED(data); return {}; }
+    using Value = ComplexTrace;
+    static Value parse(const QByteArray& data, TraceDataFormat format, bool littleEndian)
+    {
+        return parseTraceComplex(data, format, littleEndian);
+    }
 };
 
-class SENS_FREQ_STOP : public VNAcomand_REAL
+template <> struct ScpiReplyParser<ReplyKind::Block>
 {
-public:
-    SENS_FREQ_STOP(int type, qint64 freqHz)
-        : VNAcomand_REAL(false, type, QString("SENS:FREQ:STOP %1\n").arg(freqHz)) {}
-    QVector<qreal> parseResponse(const QString& data) const override { Q_UNUSED(data); return {}; }
+    using Value = QByteArray;
+    static Value parse(const QByteArray& data, TraceDataFormat format, bool littleEndian);
 };
 
-class SENS_SWE_POINT : public VNAcomand_REAL
+template <> struct ScpiReplyParser<ReplyKind::Text>
 {
-public:
-    SENS_SWE_POINT(int type, int points)
-        : VNAcomand_REAL(false, type, QString("SENS:SWE:POIN %1\n").arg(points)) {}
-    QVector<qreal> parseResponse(const QString& data) const override { Q_UNUSED(data); return {}; }
+    using Value = QByteArray;
+    static Value parse(const QByteArray& data, TraceDataFormat, bool) { return data.trimmed(); }
 };
 
-class SENS_BWID : public VNAcomand_REAL
+template <ScpiId Id>
+typename ScpiReplyParser<scpiSpec(Id).reply>::Value parseReply(const QByteArray& data, TraceDataFormat format = TraceDataFormat::Ascii,
+                                                             bool littleEndian = false)
 {
-public:
-    SENS_BWID(int type, qint64 bwHz)
-        : VNAcomand_REAL(false, type, QString("SENS:BAND %1\n").arg(bwHz)) {}
-    QVector<qreal> parseResponse(const QString& data) const override { Q_UNUSED(data); return {}; }
-};
+    return ScpiReplyParser<scpiSpec(Id).reply>::parse(data, format, littleEndian);
+}
 
-class SYSTEM_PRESET : public VNAcomand
-{
-public:
-    SYSTEM_PRESET() : VNAcomand(false, 0, "SYST:PRESet\n") {}
-};
-
-class TRIGGER_SOURCE_BUS : public VNAcomand
-{
-public:
-    TRIGGER_SOURCE_BUS() : VNAcomand(false, 0, "TRIGger:SEQuence:SOURce BUS\n") {}
-};
-
-class INITIATE_CONTINUOUS : public VNAcomand
-{
-public:
-    INITIATE_CONTINUOUS(int channel = 1)
-        : VNAcomand(false, 0, QString("INITiate%1:CONTinuous ON\n").arg(channel)) {}
-};
-
-class CALC_PARAMETER_COUNT : public VNAcomand_REAL
-{
-public:
-    CALC_PARAMETER_COUNT(int count)
-        : VNAcomand_REAL(false, 0, QString("CALC1:PAR:COUN %1\n").arg(count)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class CALC_PARAMETER_DEFINE : public VNAcomand_REAL
-{
-public:
-    CALC_PARAMETER_DEFINE(int traceNum, const QString& param)
-        : VNAcomand_REAL(false, 0, QString("CALC1:PAR%1:DEF %2\n").arg(traceNum).arg(param)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class CALC_TRACE_FORMAT : public VNAcomand_REAL
-{
-public:
-    CALC_TRACE_FORMAT(int traceNum, const QString& format)
-        : VNAcomand_REAL(false, 0, QString("CALC1:TRAC%1:FORM %2\n").arg(traceNum).arg(format)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
+// Токены аргументов для FORM:DATA / FORM:BORD
+const char* formatDataToken(TraceDataFormat format);
+inline const char* byteOrderToken(bool littleEndian) { return littleEndian ? "SWAP" : "NORM"; }
 
-class CALC_TRACE_SELECT : public VNAcomand_REAL
-{
-public:
-    CALC_TRACE_SELECT(int traceNum)
-        : VNAcomand_REAL(false, 0, QString("CALC1:PAR%1:SEL\n").arg(traceNum)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class DISP_WIND_TRACE : public VNAcomand_REAL
-{
-public:
-    DISP_WIND_TRACE(int windowNum, int traceNum)
-        : VNAcomand_REAL(false, 0, QString("DISP:WIND%1:TRAC%2:ACT\n").arg(windowNum).arg(traceNum)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class CALC_TRACE_DATA_XAXIS : public VNAcomand_REAL
-{
-public:
-    CALC_TRACE_DATA_XAXIS(int traceNum)
-        : VNAcomand_REAL(true, traceNum, QString("CALC:TRAC%1:DATA:XAXIS?\n").arg(traceNum)) {}
-    QVector<qreal> parseResponse(const QString& data) const override;
-};
-
-
-class SOURCE_POWER_LEVEL_SET : public VNAcomand
-{
-public:
-    SOURCE_POWER_LEVEL_SET(int channel, qreal powerDbM)
-        : VNAcomand(false, 0, QString("SOURce%1:POWer:LEVel:IMMediate:AMPLitude %2\n").arg(channel).arg(powerDbM)) {}
-};
-
-class OUTPUT_PORT_STATE : public VNAcomand
-{
-public:
-    OUTPUT_PORT_STATE(int port, bool state)
-        : VNAcomand(false, 0, QString("OUTPut%1:STATe %2\n").arg(port).arg(state ? "ON" : "OFF")) {}
-};
-
-class CALC_TRACE_FORMAT_POWER : public VNAcomand
-{
-public:
-    CALC_TRACE_FORMAT_POWER(int traceNum, const QString& format)
-        : VNAcomand(false, 0, QString("CALC:TRAC%1:FORM %2\n").arg(traceNum).arg(format)) {}
-};
-
-class CALC_PARAMETER_POWER : public VNAcomand
-{
-public:
-    CALC_PARAMETER_POWER(int traceNum, const QString& parameter)
-        : VNAcomand(false, 0, QString("CALC:PAR%1:DEF %2\n").arg(traceNum).arg(parameter)) {}
-};
-
-class CALC_TRACE_DATA_POWER : public VNAcomand_REAL
-{
-public:
-    CALC_TRACE_DATA_POWER(int traceNum)
-        : VNAcomand_REAL(true, traceNum, QString("CALC:TRAC%1:DATA:FDAT?\n").arg(traceNum)) {}
-    QVector<qreal> parseResponse(const QString& data) const override;
-};
-
-class TRIGGER_SINGLE : public VNAcomand {
-public:
-    TRIGGER_SINGLE() : VNAcomand(false, 0, "TRIG:SING\n") {}
-};
-
-class OPC_QUERY : public VNAcomand
-{
-public:
-    OPC_QUERY() : VNAcomand(true, 0, "*OPC?\n") {}
-};
-
-class ABORT_COMMAND : public VNAcomand
-{
-public:
-    ABORT_COMMAND() : VNAcomand(false, 0, ":ABOR\n") {}
-};
-
-class INITIATE_SINGLE_SHOT : public VNAcomand
-{
-public:
-    INITIATE_SINGLE_SHOT(int channel = 1)
-        : VNAcomand(false, 0, QString("INITiate%1:CONTinuous OFF\n").arg(channel)) {}
-};
-
-class INIT_CONT_MODE : public VNAcomand
-{
-public:
-    explicit INIT_CONT_MODE(int ch = 1, bool on = true)
-        : VNAcomand(false, ch, QString("INITiate%1:CONTinuous %2\n").arg(ch).arg(on ? "ON" : "OFF")) {}
-};
-
-class CALC_PARAMETER_SPORT : public VNAcomand_REAL
-{
-public:
-    CALC_PARAMETER_SPORT(int traceNum, int port)
-        : VNAcomand_REAL(false, 0, QString("CALC1:PAR%1:SPOR %2\n").arg(traceNum).arg(port)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class SOURCE_POWER_LEVEL : public VNAcomand_REAL
-{
-public:
-    SOURCE_POWER_LEVEL(int channel, double powerDbM)
-        : VNAcomand_REAL(false, 0, QString("SOURce%1:POWer:LEVel:IMMediate:AMPLitude %2\n").arg(channel).arg(powerDbM)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class SENSE_SWEEP_TYPE : public VNAcomand_REAL
-{
-public:
-    SENSE_SWEEP_TYPE(int channel, const QString& sweepType)
-        : VNAcomand_REAL(false, 0, QString("SENSe%1:SWEep:TYPE %2\n").arg(channel).arg(sweepType)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class SOURCE_POWER_SPAN : public VNAcomand_REAL
-{
-public:
-    SOURCE_POWER_SPAN(int channel, double powerSpan)
-        : VNAcomand_REAL(false, 0, QString("SOURce%1:POWer:SPAN %2\n").arg(channel).arg(powerSpan)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class SENS_FREQ_FIXED : public VNAcomand_REAL
-{
-public:
-    SENS_FREQ_FIXED(int channel, qint64 freqHz)
-        : VNAcomand_REAL(false, 0, QString("SENS:FREQ:FIXed %1\n").arg(freqHz)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-
-class SENS_FREQ_CW : public VNAcomand_REAL
-{
-public:
-    SENS_FREQ_CW(int channel, qint64 freqHz)
-        : VNAcomand_REAL(false, 0, QString("SENS:FREQ:CW %1\n").arg(freqHz)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
-
-class SENS_FREQ_CENTER : public VNAcomand_REAL
-{
-public:
-    SENS_FREQ_CENTER(int channel, qint64 freqHz)
-        : VNAcomand_REAL(false, 0, QString("SENS:FREQ:CENT %1\n").arg(freqHz)) {}
-    QVector<qreal> parseResponse(const QString&) const override { return {}; }
-};
 #endif // VNACOMAND_H
@@ -2,58 +2,58 @@
 #define VNACONTROLLER_H
 
 #include <QObject>
+#include <QString>
 #include <QVector>
-#include <QTimer>
-#include <QHostAddress>
+#include "sweepframe.h"
 #include "vnacomand.h"
-#include "vnaclient.h"
 
-// Информация о трейсе (графике) хранится здесь
+class DeviceManager;
+
+// Трасса, как её настроил оператор
 struct TraceInfo {
-    int num;            // 1..16
-    QString param;      // "S11" / "S21" / ...
-    QString unit;       // отображаемая строка (для UI). На приборе — формат команды CALC:FORM? (можно мапить)
+    int num = 0;            // 1..16
+    QString param;          // "S11" / "S21" / ...
+    int port = 0;           // порт источника, 0 — по умолчанию прибора
+    QString format;         // формат CALC:FORM (MLOG, PHAS, ...)
 };
 
+// Планировщик опроса трасс: хранит конфигурацию трасс, собирает из неё
+// команды настройки и решает, какие трассы читать в каждом свипе.
+// Трасса в фокусе читается каждый свип, фоновые — раз в N свипов со
+// сдвигом, чтобы в каждом свипе читалась примерно одинаковая их доля.
 class VnaController : public QObject {
     Q_OBJECT
 public:
-    explicit VnaController(VNAclient *client, QObject *parent = nullptr);
-    ~VnaController() override;
-
-    // Настроечные методы (вызываются из Widget/QML)
-    Q_SLOT void configureAndStart(int startKHz, int stopKHz, int points, int bandwidthHz,
-                                  const QVector<TraceInfo> &traces);
-    Q_SLOT void updateTraces(const QVector<TraceInfo> &traces);
-    Q_SLOT void stop();
-
-signals:
-    // отправить набор команд на клиент (Widget подписан и пробросит на Socket в отдельном потоке)
-    void sendCommands(const QHostAddress &host, quint16 port, QVector<VNAcomand*> commands);
+    explicit VnaController(DeviceManager *devices, QObject *parent = nullptr);
 
-    // сигнал для UI: пришли данные по трейсу
-    void traceDataReady(int traceNum, QVector<qreal> values);
+    void setTraces(const QVector<TraceInfo> &traces, const QString &sweepType, qint64 powerFreqHz);
+    const QVector<TraceInfo> &traces() const { return m_traces; }
 
-    // если контроллер получил от клиента сырый ответ и хочет его показать
-    void rawVnaResponse(const QString &scpiCmd, const QString &response);
+    // 0 — без фокуса, все трассы каждый свип
+    void setFocusTrace(int num);
+    int focusTrace() const { return m_focusTrace; }
+    void setBackgroundRefresh(int everySweeps);
+    int backgroundRefresh() const { return m_backgroundEvery; }
+    // Широкий свип снимается сегментами по pointsPerSegment точек (0 — целиком).
+    // Делится только линейный частотный свип
+    void setSegmentPoints(int pointsPerSegment);
+    int segmentPoints() const { return m_segmentPoints; }
 
-private slots:
-    void onClientDataReceived(const QString &data, VNAcomand *cmd);
+    QVector<TraceFetchPlan> fetchPlan() const;
+    // Сколько запросов FDAT? в среднем уходит за свип
+    double queriesPerSweep() const;
 
 private:
-    VNAclient *m_client;
-    QTimer *m_pollTimer = nullptr;
-    QVector<TraceInfo> m_traces;
-    int m_currentPollIndex = 0;
-
-    // параметры сканирования
-    qint64 m_startHz = 0;
-    qint64 m_stopHz = 0;
-    int m_points = 201;
-    qint64 m_bandHz = 10000;
+    QVector<ScpiCommand> setupCommands() const;
+    void applySegmentation();
 
-    void configureInstrument();      // формирует и посылает команды конфигурации
-    void pollNextTrace();            // посылает CALC:SEL:DATA:FDAT? для следующего трейса
+    DeviceManager *m_devices;
+    QVector<TraceInfo> m_traces;
+    QString m_sweepType;
+    qint64 m_powerFreqHz = 0;
+    int m_focusTrace = 0;
+    int m_backgroundEvery = 1;
+    int m_segmentPoints = 0;
 };
 
 #endif // VNACONTROLLER_H
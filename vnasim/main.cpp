@@ -0,0 +1,48 @@
+#include "vnasimulator.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("vnasim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Локальный симулятор ВАЦ (SCPI поверх TCP) для отладки и измерений без прибора");
+    parser.addHelpOption();
+
+    const QCommandLineOption portOption("port", "TCP port.", "port", "5025");
+    const QCommandLineOption sweepTimeOption("sweep-time", "Fixed sweep time, ms.", "ms", "50");
+    const QCommandLineOption pointTimeOption("point-time-us", "Additional sweep time per point, us.", "us", "10");
+    const QCommandLineOption latencyOption("latency", "Delay before every reply, ms.", "ms", "0");
+    const QCommandLineOption fragmentOption("fragment", "Split replies into chunks of this size, bytes (0 = off).", "bytes", "0");
+    const QCommandLineOption fragmentGapOption("fragment-gap", "Pause between chunks, ms.", "ms", "1");
+    const QCommandLineOption dropRateOption("drop-rate", "Probability of dropping a query reply (0..1).", "rate", "0");
+    const QCommandLineOption seedOption("seed", "Random seed for reply drops.", "seed", "1");
+    const QCommandLineOption pointsOption("points", "Points after preset.", "points", "201");
+    const QCommandLineOption verboseOption("verbose", "Log every command.");
+    parser.addOptions({portOption, sweepTimeOption, pointTimeOption, latencyOption, fragmentOption,
+                       fragmentGapOption, dropRateOption, seedOption, pointsOption, verboseOption});
+    parser.process(app);
+
+    SimulatorOptions options;
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.sweepTimeMs = parser.value(sweepTimeOption).toInt();
+    options.pointTimeUs = parser.value(pointTimeOption).toInt();
+    options.latencyMs = parser.value(latencyOption).toInt();
+    options.fragmentBytes = parser.value(fragmentOption).toInt();
+    options.fragmentGapMs = parser.value(fragmentGapOption).toInt();
+    options.dropRate = parser.value(dropRateOption).toDouble();
+    options.seed = parser.value(seedOption).toUInt();
+    options.defaultPoints = parser.value(pointsOption).toInt();
+    options.verbose = parser.isSet(verboseOption);
+
+    VnaSimulator simulator(options);
+    if (!simulator.listen(QHostAddress::Any)) {
+        qWarning() << "vnasim: cannot listen on port" << options.port << ":" << simulator.errorString();
+        return 1;
+    }
+    qDebug() << "vnasim: listening on port" << simulator.serverPort();
+    return app.exec();
+}
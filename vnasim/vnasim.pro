@@ -0,0 +1,13 @@
+QT = core network
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TARGET = vnasim
+
+SOURCES += \
+    main.cpp \
+    vnasimulator.cpp
+
+HEADERS += \
+    vnasimulator.h
@@ -0,0 +1,391 @@
+#include "vnasimulator.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QDebug>
+#include <QtEndian>
+#include <charconv>
+#include <cmath>
+#include <complex>
+#include <cstring>
+
+namespace {
+
+struct ParsedHeader
+{
+    QList<QByteArray> nodes;     // короткие имена без числовых суффиксов
+    QVector<int> suffixes;       // суффикс каждого узла, 1 если не указан
+    bool query = false;
+};
+
+ParsedHeader parseHeader(const QByteArray& header)
+{
+    ParsedHeader parsed;
+    QByteArray h = header.trimmed().toUpper();
+    if (h.endsWith('?')) {
+        parsed.query = true;
+        h.chop(1);
+    }
+    if (h.startsWith(':')) h.remove(0, 1);
+    const QList<QByteArray> nodes = h.split(':');
+    for (const QByteArray& node : nodes) {
+        qsizetype end = node.size();
+        while (end > 0 && node.at(end - 1) >= '0' && node.at(end - 1) <= '9') --end;
+        parsed.nodes.append(node.left(end));
+        parsed.suffixes.append(end < node.size() ? node.mid(end).toInt() : 1);
+    }
+    return parsed;
+}
+
+// pattern — короткая форма, например "CALC:TRAC:DATA:FDAT?"; узел заголовка
+// совпадает, если начинается с короткой формы (TRACE, TRAC — обе подходят).
+bool matches(const ParsedHeader& parsed, const char* pattern)
+{
+    QByteArray p(pattern);
+    const bool query = p.endsWith('?');
+    if (query) p.chop(1);
+    if (query != parsed.query) return false;
+    const QList<QByteArray> nodes = p.split(':');
+    if (nodes.size() != parsed.nodes.size()) return false;
+    for (qsizetype i = 0; i < nodes.size(); ++i) {
+        if (!parsed.nodes.at(i).startsWith(nodes.at(i))) return false;
+    }
+    return true;
+}
+
+// Ключ настройки: узлы с суффиксами, одинаковый у команды и её запроса
+QByteArray settingKey(const ParsedHeader& parsed)
+{
+    QByteArray key;
+    for (qsizetype i = 0; i < parsed.nodes.size(); ++i) {
+        key += parsed.nodes.at(i) + QByteArray::number(parsed.suffixes.at(i)) + ':';
+    }
+    return key;
+}
+
+QByteArray unquote(const QByteArray& arg)
+{
+    QByteArray a = arg.trimmed();
+    if (a.size() >= 2 && (a.startsWith('\'') || a.startsWith('"'))) a = a.mid(1, a.size() - 2);
+    return a;
+}
+
+} // namespace
+
+VnaSimulator::VnaSimulator(const SimulatorOptions& options, QObject* parent)
+    : QObject(parent)
+    , _options(options)
+    , _server(new QTcpServer(this))
+    , _random(options.seed)
+    , _startHz(20e3)
+    , _stopHz(4.8e9)
+    , _points(options.defaultPoints)
+    , _dataFormat("ASC")
+    , _swapped(false)
+    , _statusEnable(0)
+    , _sweepEndsMs(0)
+    , _sweepsCompleted(0)
+    , _sweepCounter(0)
+    , _repliesDropped(0)
+    , _bytesSent(0)
+{
+    _clock.start();
+    preset();
+    connect(_server, &QTcpServer::newConnection, this, &VnaSimulator::onNewConnection);
+}
+
+VnaSimulator::~VnaSimulator()
+{
+    qDeleteAll(_sessions);
+}
+
+bool VnaSimulator::listen(const QHostAddress& address)
+{
+    return _server->listen(address, _options.port);
+}
+
+quint16 VnaSimulator::serverPort() const
+{
+    return _server->serverPort();
+}
+
+QString VnaSimulator::errorString() const
+{
+    return _server->errorString();
+}
+
+void VnaSimulator::onNewConnection()
+{
+    while (_server->hasPendingConnections()) {
+        Session* session = new Session;
+        session->socket = _server->nextPendingConnection();
+        session->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        session->writeTimer = new QTimer(this);
+        session->writeTimer->setSingleShot(true);
+        _sessions.append(session);
+        connect(session->writeTimer, &QTimer::timeout, this, [this, session]() { pumpOutput(session); });
+        connect(session->socket, &QTcpSocket::readyRead, this, [this, session]() { onReadyRead(session); });
+        connect(session->socket, &QTcpSocket::disconnected, this, [this, session]() { closeSession(session); });
+        if (_options.verbose) {
+            qDebug() << "vnasim: client connected from" << session->socket->peerAddress().toString();
+        }
+    }
+}
+
+void VnaSimulator::closeSession(Session* session)
+{
+    if (!_sessions.removeOne(session)) return;
+    if (_options.verbose) qDebug() << "vnasim: client disconnected";
+    session->writeTimer->stop();
+    session->writeTimer->deleteLater();
+    session->socket->deleteLater();
+    delete session;
+}
+
+void VnaSimulator::onReadyRead(Session* session)
+{
+    session->input.append(session->socket->readAll());
+    qsizetype nl;
+    while ((nl = session->input.indexOf('\n')) >= 0) {
+        const QByteArray line = session->input.left(nl).trimmed();
+        session->input.remove(0, nl + 1);
+        if (!line.isEmpty()) executeLine(session, line);
+    }
+}
+
+void VnaSimulator::executeLine(Session* session, const QByteArray& line)
+{
+    // составные сообщения: "CMD1;:CMD2;*OPC?"
+    for (const QByteArray& unit : line.split(';')) {
+        const QByteArray command = unit.trimmed();
+        if (!command.isEmpty()) executeCommand(session, command);
+    }
+}
+
+void VnaSimulator::executeCommand(Session* session, const QByteArray& command)
+{
+    if (_options.verbose) qDebug() << "vnasim:" << command;
+
+    const qsizetype space = command.indexOf(' ');
+    const QByteArray header = space < 0 ? command : command.left(space);
+    const QByteArray arg = space < 0 ? QByteArray() : command.mid(space + 1).trimmed();
+    const ParsedHeader h = parseHeader(header);
+    const QByteArray argUpper = arg.toUpper();
+
+    if (header.startsWith('*')) {
+        const QByteArray common = header.toUpper();
+        if (common == "*IDN?") {
+            queueReply(session, "TAIR,VNASIM,0,1.0\n");
+        } else if (common == "*OPC?") {
+            queueReply(session, "1\n", _sweepEndsMs);
+        } else if (common == "*ESE") {
+            _statusEnable = qBound(0, arg.toInt(), 255);
+        } else if (common == "*ESE?") {
+            queueReply(session, QByteArray::number(_statusEnable) + '\n');
+        } else if (common == "*RST") {
+            preset();
+        }
+        return;
+    }
+
+    if (!h.query && !arg.isEmpty()) _settings.insert(settingKey(h), arg);
+
+    if (matches(h, "SYST:PRES")) {
+        preset();
+    } else if (matches(h, "FORM:DATA") || matches(h, "FORM")) {
+        _dataFormat = argUpper.startsWith("REAL32") ? "REAL32" : argUpper.startsWith("REAL") ? "REAL" : "ASC";
+    } else if (matches(h, "FORM:BORD")) {
+        _swapped = argUpper.startsWith("SWAP");
+    } else if (matches(h, "SENS:FREQ:STAR")) {
+        _startHz = arg.toDouble();
+    } else if (matches(h, "SENS:FREQ:STOP")) {
+        _stopHz = arg.toDouble();
+    } else if (matches(h, "SENS:SWE:POIN")) {
+        _points = qBound(2, arg.toInt(), 500001);
+    } else if (matches(h, "SENS:SWE:POIN?")) {
+        queueReply(session, QByteArray::number(_points) + '\n');
+    } else if (matches(h, "CALC:PAR:COUN")) {
+        const int count = qBound(1, arg.toInt(), 16);
+        for (int t = 1; t <= count; ++t) {
+            if (!_traces.contains(t)) _traces.insert(t, SimTrace());
+        }
+        for (auto it = _traces.begin(); it != _traces.end();) {
+            if (it.key() > count) it = _traces.erase(it); else ++it;
+        }
+    } else if (matches(h, "CALC:PAR:DEF")) {
+        _traces[h.suffixes.at(1)].param = QString::fromLatin1(unquote(arg));
+    } else if (matches(h, "CALC:PAR:DEL")) {
+        const QByteArray name = unquote(arg);
+        _traces.remove(name.mid(2).toInt());
+    } else if (matches(h, "CALC:TRAC:FORM")) {
+        _traces[h.suffixes.at(1)].format = QString::fromLatin1(argUpper);
+    } else if (matches(h, "TRIG:SING") || matches(h, "TRIG:SEQ:SING") || matches(h, "INIT")) {
+        triggerSweep();
+    } else if (matches(h, "CALC:TRAC:DATA:FDAT?")) {
+        queueReply(session, formatValues(traceData(h.suffixes.at(1))));
+    } else if (matches(h, "CALC:TRAC:DATA:XAX?")) {
+        queueReply(session, formatValues(frequencyAxis()));
+    } else if (h.query) {
+        // прочие запросы — последнее значение настройки или "0", чтобы клиент не ждал таймаута
+        queueReply(session, _settings.value(settingKey(h), "0") + '\n');
+    }
+    // остальные команды (BAND, SOUR:POW, TRIG:SOUR, INIT:CONT, ABOR, DISP...) принимаются без эффекта
+}
+
+void VnaSimulator::queueReply(Session* session, const QByteArray& reply, qint64 notBeforeMs)
+{
+    if (_options.dropRate > 0.0 && _random.generateDouble() < _options.dropRate) {
+        ++_repliesDropped;
+        if (_options.verbose) qDebug() << "vnasim: dropping reply of" << reply.size() << "bytes";
+        return;
+    }
+    const qint64 now = _clock.elapsed();
+    qint64 due = qMax(now + _options.latencyMs, notBeforeMs);
+    due = qMax(due, session->lastDueMs);
+    if (_options.fragmentBytes > 0 && reply.size() > _options.fragmentBytes) {
+        for (qsizetype offset = 0; offset < reply.size(); offset += _options.fragmentBytes) {
+            session->output.enqueue(qMakePair(due, reply.mid(offset, _options.fragmentBytes)));
+            due += _options.fragmentGapMs;
+        }
+    } else {
+        session->output.enqueue(qMakePair(due, reply));
+    }
+    session->lastDueMs = due;
+    pumpOutput(session);
+}
+
+void VnaSimulator::pumpOutput(Session* session)
+{
+    const qint64 now = _clock.elapsed();
+    while (!session->output.isEmpty() && session->output.head().first <= now) {
+        const QByteArray chunk = session->output.dequeue().second;
+        session->socket->write(chunk);
+        _bytesSent += quint64(chunk.size());
+        if (_options.fragmentBytes > 0) {
+            // отдельный сегмент TCP на каждый кусок
+            session->socket->flush();
+        }
+    }
+    if (!session->output.isEmpty()) {
+        session->writeTimer->start(int(session->output.head().first - now));
+    }
+}
+
+void VnaSimulator::preset()
+{
+    _startHz = 20e3;
+    _stopHz = 4.8e9;
+    _points = _options.defaultPoints;
+    _dataFormat = "ASC";
+    _swapped = false;
+    _traces.clear();
+    _traces.insert(1, SimTrace());
+    _settings.clear();
+}
+
+void VnaSimulator::triggerSweep()
+{
+    const qint64 now = qMax(_clock.elapsed(), _sweepEndsMs);
+    _sweepEndsMs = now + _options.sweepTimeMs + qint64(_points) * _options.pointTimeUs / 1000;
+    ++_sweepCounter;
+    ++_sweepsCompleted;
+}
+
+QVector<double> VnaSimulator::frequencyAxis() const
+{
+    QVector<double> out(_points);
+    const double step = _points > 1 ? (_stopHz - _startHz) / (_points - 1) : 0.0;
+    for (int i = 0; i < _points; ++i)
+        out[i] = _startHz + step * i;
+    return out;
+}
+
+QVector<double> VnaSimulator::traceData(int traceNum) const
+{
+    // Резонатор с добротностью Q на частоте, зависящей от номера трассы,
+    // плюс слабая рябь, меняющаяся от свипа к свипу.
+    const SimTrace trace = _traces.value(traceNum);
+    const QString fmt = trace.format.toUpper();
+    const double span = _stopHz - _startHz;
+    const double f0 = _startHz + span * (0.2 + 0.15 * ((traceNum - 1) % 5));
+    const double q = 50.0;
+    const double depth = 0.8;
+    const double ripple = 0.02 * std::sin(double(_sweepCounter) * 0.3);
+    const double step = _points > 1 ? span / (_points - 1) : 0.0;
+
+    QVector<double> out(2 * _points);
+    for (int i = 0; i < _points; ++i) {
+        const double f = qMax(1.0, _startHz + step * i);
+        const double detune = q * (f / f0 - f0 / f);
+        std::complex<double> s = 1.0 - depth / std::complex<double>(1.0, detune);
+        s *= (1.0 - ripple) * std::polar(1.0, -2.0 * M_PI * f * 1e-9);
+        const double mag = std::abs(s);
+        double re = 0.0;
+        double im = 0.0;
+        if (fmt.startsWith("SMIT") || fmt.startsWith("POL") || fmt.startsWith("SCOM")
+            || fmt.startsWith("SLIN") || fmt.startsWith("SLOG") || fmt.startsWith("SADM")
+            || fmt.startsWith("PLIN") || fmt.startsWith("PLOG")) {
+            re = s.real();
+            im = s.imag();
+        } else if (fmt.startsWith("PHAS") || fmt.startsWith("UPH")) {
+            re = std::arg(s) * 180.0 / M_PI;
+        } else if (fmt.startsWith("MLIN")) {
+            re = mag;
+        } else if (fmt.startsWith("SWR")) {
+            re = (1.0 + mag) / (1.0 - qMin(mag, 0.999));
+        } else if (fmt.startsWith("REAL")) {
+            re = s.real();
+        } else if (fmt.startsWith("IMAG")) {
+            re = s.imag();
+        } else if (fmt.startsWith("GDEL")) {
+            re = 1e-9;
+        } else {
+            re = 20.0 * std::log10(qMax(mag, 1e-12));
+        }
+        out[2 * i] = re;
+        out[2 * i + 1] = im;
+    }
+    return out;
+}
+
+QByteArray VnaSimulator::formatValues(const QVector<double>& values) const
+{
+    QByteArray out;
+    if (_dataFormat == "ASC") {
+        out.resize(values.size() * 24 + 1);
+        char* p = out.data();
+        char* end = p + out.size();
+        for (qsizetype i = 0; i < values.size(); ++i) {
+            if (i) *p++ = ',';
+            p = std::to_chars(p, end, values[i], std::chars_format::scientific, 9).ptr;
+        }
+        *p++ = '\n';
+        out.resize(p - out.data());
+        return out;
+    }
+
+    const bool real32 = _dataFormat == "REAL32";
+    const qsizetype payload = values.size() * (real32 ? 4 : 8);
+    const QByteArray length = QByteArray::number(qint64(payload));
+    out.reserve(2 + length.size() + payload + 1);
+    out.append('#');
+    out.append(char('0' + length.size()));
+    out.append(length);
+    const qsizetype offset = out.size();
+    out.resize(offset + payload);
+    char* dst = out.data() + offset;
+    for (qsizetype i = 0; i < values.size(); ++i) {
+        if (real32) {
+            const float v = float(values[i]);
+            quint32 raw;
+            std::memcpy(&raw, &v, sizeof(raw));
+            if (_swapped) qToLittleEndian(raw, dst + 4 * i); else qToBigEndian(raw, dst + 4 * i);
+        } else {
+            quint64 raw;
+            std::memcpy(&raw, &values[i], sizeof(raw));
+            if (_swapped) qToLittleEndian(raw, dst + 8 * i); else qToBigEndian(raw, dst + 8 * i);
+        }
+    }
+    out.append('\n');
+    return out;
+}
@@ -0,0 +1,105 @@
+#ifndef VNASIMULATOR_H
+#define VNASIMULATOR_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QString>
+#include <QVector>
+
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+struct SimulatorOptions
+{
+    quint16 port = 5025;
+    int sweepTimeMs = 50;          // фиксированная часть времени свипа
+    int pointTimeUs = 10;          // добавка на каждую точку
+    int latencyMs = 0;             // задержка каждого ответа
+    int fragmentBytes = 0;         // > 0 — ответы пишутся кусками такого размера
+    int fragmentGapMs = 1;         // пауза между кусками
+    double dropRate = 0.0;         // вероятность потерять ответ на запрос
+    quint32 seed = 1;
+    int defaultPoints = 201;
+    bool verbose = false;
+};
+
+struct SimTrace
+{
+    QString param = "S11";
+    QString format = "MLOG";
+};
+
+class VnaSimulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit VnaSimulator(const SimulatorOptions& options, QObject* parent = nullptr);
+    ~VnaSimulator();
+
+    bool listen(const QHostAddress& address = QHostAddress::LocalHost);
+    quint16 serverPort() const;
+    QString errorString() const;
+
+    quint64 sweepsCompleted() const { return _sweepsCompleted; }
+    quint64 repliesDropped() const { return _repliesDropped; }
+    quint64 bytesSent() const { return _bytesSent; }
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Session
+    {
+        QTcpSocket* socket = nullptr;
+        QTimer* writeTimer = nullptr;
+        QByteArray input;
+        QQueue<QPair<qint64, QByteArray>> output;   // время отправки, байты
+        qint64 lastDueMs = 0;
+    };
+
+    void onReadyRead(Session* session);
+    void executeLine(Session* session, const QByteArray& line);
+    void executeCommand(Session* session, const QByteArray& command);
+    void queueReply(Session* session, const QByteArray& reply, qint64 notBeforeMs = 0);
+    void pumpOutput(Session* session);
+    void closeSession(Session* session);
+
+    void preset();
+    void triggerSweep();
+    QByteArray formatValues(const QVector<double>& values) const;
+    QVector<double> frequencyAxis() const;
+    QVector<double> traceData(int traceNum) const;
+
+    SimulatorOptions _options;
+    QTcpServer* _server;
+    QList<Session*> _sessions;
+    QElapsedTimer _clock;
+    QRandomGenerator _random;
+
+    // состояние прибора
+    double _startHz;
+    double _stopHz;
+    int _points;
+    QString _dataFormat;
+    bool _swapped;
+    int _statusEnable;                          // *ESE: клиент проверяет им синхронность ответов
+    QMap<int, SimTrace> _traces;
+    QHash<QByteArray, QByteArray> _settings;    // последний аргумент каждой настройки, для запросов "<заголовок>?"
+    qint64 _sweepEndsMs;
+    quint64 _sweepsCompleted;
+    quint64 _sweepCounter;
+    quint64 _repliesDropped;
+    quint64 _bytesSent;
+};
+
+#endif // VNASIMULATOR_H
@@ -1,5 +1,8 @@
 #include "widget.h"
 #include "socket.h"
+#include "replayclient.h"
+#include "sweepexporter.h"
+#include "vnacontroller.h"
 #include <QHBoxLayout>
 #include <QQmlContext>
 #include <QQuickWidget>
@@ -8,6 +11,11 @@
 #include <QMessageBox>
 #include <QChartView>
 #include <QApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QTimer>
+
+#define STATS_REFRESH_MS 1000
 
 static QString unitToScpi(const QString& unit)
 {
@@ -20,15 +28,23 @@ static QString unitToScpi(const QString& unit)
                                               {"Амп лин", "MLIN"},
                                               {"Реал", "REAL"},
                                               {"Мним", "IMAG"},
+                                              {"Полярн", "POL"},
                                               };
     return unitMap.value(unit, "MLOG");
 }
 
-Widget::Widget(VNAclient* client, QWidget* parent)
+Widget::Widget(DeviceManager* devices, QWidget* parent)
     : QWidget(parent)
-    , _vnaClient(client)
+    , _devices(devices)
+    , _vnaClient(devices->socket(devices->primaryDevice()))
     , _chartManager(nullptr)
     , _chartView(nullptr)
+    , _statsTimer(nullptr)
+    , _replay(nullptr)
+    , _replayPosition(-1)
+    , _exporter(nullptr)
+    , _controller(nullptr)
+    , _math(nullptr)
     , _currentIP("127.0.0.1")
     , _currentPort(5025)
     , _currentStartKHz(20)
@@ -41,22 +57,40 @@ Widget::Widget(VNAclient* client, QWidget* parent)
     _chartManager = new CreaterChart(this);
     setupUi();
 
-    qRegisterMetaType<QVector<VNAcomand*>>();
+    qRegisterMetaType<ScpiCommand>("ScpiCommand");
+    qRegisterMetaType<QVector<ScpiCommand>>("QVector<ScpiCommand>");
     qRegisterMetaType<QHostAddress>();
-
-    connect(_vnaClient, &VNAclient::dataFromVNA, this, &Widget::dataFromVNA, Qt::QueuedConnection);
-    connect(_vnaClient, &VNAclient::error, this, &Widget::errorMessage, Qt::QueuedConnection);
+    qRegisterMetaType<SweepFramePtr>("SweepFramePtr");
+
+    connect(_devices, &DeviceManager::dataFromDevice, this, &Widget::dataFromVNA);
+    connect(_devices, &DeviceManager::sweepReady, this, &Widget::onSweepReady);
+    connect(_devices, &DeviceManager::sweepSegmentReady, this, &Widget::onSweepSegment);
+    connect(_devices, &DeviceManager::deviceError, this, &Widget::errorMessage);
+    connect(_devices, &DeviceManager::devicesChanged, this, &Widget::devicesChanged);
+
+    _controller = new VnaController(_devices, this);
+    _math = new TraceMathEngine();
+    connect(_math, &TraceMathEngine::sweepProcessed, this, [this](int deviceId) {
+        if (SweepFramePtr frame = _math->takeProcessed(deviceId)) displaySweep(deviceId, frame);
+    });
+    _math->startThread();
+    _exporter = new SweepExporter(this);
+    connect(_exporter, &SweepExporter::progress, this, &Widget::exportProgress);
+    connect(_exporter, &SweepExporter::exportFinished, this, &Widget::exportFinished);
+
+    _statsTimer = new QTimer(this);
+    connect(_statsTimer, &QTimer::timeout, this, &Widget::socketStatsChanged);
+    _statsTimer->start(STATS_REFRESH_MS);
 
     setOptimalScanSettings();
-    startSocketThread();
 }
 
 Widget::~Widget()
 {
-    stopSocketThread();
-    if (_vnaClient) {
-        QMetaObject::invokeMethod(_vnaClient, "stopScan", Qt::BlockingQueuedConnection);
-    }
+    delete _replay;
+    delete _math;
+    _devices->stopAll();
+    _devices->shutdown();
 }
 
 void Widget::setupUi()
@@ -81,10 +115,7 @@ void Widget::setupUi()
 
 void Widget::setOptimalScanSettings()
 {
-    Socket* socket = qobject_cast<Socket*>(_vnaClient);
-    if (socket) {
-        socket->setTimeouts(20000, 60000, 2000);
-    }
+    _devices->setTimeouts(20000, 60000, 50);
 }
 
 void Widget::startScanFromQml(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz)
@@ -111,31 +142,26 @@ void Widget::startScanFromQml(const QString& ip, quint16 port, int startKHz, int
     _currentPowerDbM = powerDbM;
     _currentPowerFreqKHz = powerFreqKHz;
 
-    Socket* socket = qobject_cast<Socket*>(_vnaClient);
-    if (socket && !socket->canConnect(ip, port)) {
-        showIpPortError("Прибор недоступен по указанному IP/порт");
-        return;
-    }
-
-    QMetaObject::invokeMethod(
-        _vnaClient, "startScan", Qt::QueuedConnection,
-        Q_ARG(QString, ip),
-        Q_ARG(quint16, port),
-        Q_ARG(int, startKHz),
-        Q_ARG(int, stopKHz),
-        Q_ARG(int, points),
-        Q_ARG(int, band),
-        Q_ARG(double, powerDbM),
-        Q_ARG(int, powerFreqKHz)
-        );
+    // соединение устанавливается в потоке сокета; если прибор недоступен,
+    // придёт deviceError, а Socket продолжит попытки подключения
+    _devices->setDeviceAddress(_devices->primaryDevice(), ip, port);
+    ScanParameters scan;
+    scan.startKHz = startKHz;
+    scan.stopKHz = stopKHz;
+    scan.points = points;
+    scan.band = band;
+    scan.powerDbM = powerDbM;
+    scan.powerFreqKHz = powerFreqKHz;
+    // среднее по прежнему диапазону к новому не относится
+    _math->restartAveraging();
+    _devices->startAll(scan);
 }
 
 void Widget::stopScanFromQml(const QString& ip, int port)
 {
     Q_UNUSED(ip)
     Q_UNUSED(port)
-    if (!_vnaClient) return;
-    QMetaObject::invokeMethod(_vnaClient, "stopScan", Qt::QueuedConnection);
+    _devices->stopAll();
 }
 
 void Widget::applyGraphSettings(const QVariantList& graphs, const QVariantMap& params)
@@ -145,26 +171,21 @@ void Widget::applyGraphSettings(const QVariantList& graphs, const QVariantMap& p
     qDebug() << "Applying graph settings with sweep type:" << sweepType;
 
     _chartManager->clearAllTraces();
-    QVector<VNAcomand*> cmds;
-    QVector<int> traceNumbers;
-    int graphCount = graphs.size();
-    cmds.append(new SENSE_SWEEP_TYPE(1, sweepType));
-    if (sweepType == "POW") {
-        qint64 powerFreqHz = qint64(_currentPowerFreqKHz) * 1000LL;
-        cmds.append(new SENS_FREQ_FIXED(1, powerFreqHz));
-    }
-
-    cmds.append(new CALC_PARAMETER_COUNT(graphCount));
+    _traces.clear();
+    QVector<TraceInfo> traces;
+    const qint64 powerFreqHz = qint64(_currentPowerFreqKHz) * 1000LL;
 
     for (const QVariant& v : graphs) {
         QVariantMap g = v.toMap();
         int num = g.value("num").toInt();
         QString type = g.value("type").toString();
-        QString unit = g.value("unit").toString();
         int port = g.value("port", 0).toInt();
-        QString scpiUnit = unitToScpi(unit);
-
-        QColor traceColor = QColor::fromHsv((num * 40) % 360, 200, 200);
+        TraceInfo info;
+        info.num = num;
+        info.param = type;
+        info.port = port;
+        info.format = unitToScpi(g.value("unit").toString());
+        traces.append(info);
 
         QString traceName;
         if (port > 0) {
@@ -172,64 +193,86 @@ void Widget::applyGraphSettings(const QVariantList& graphs, const QVariantMap& p
         } else {
             traceName = QString("Trace %1 (%2)").arg(num).arg(type);
         }
+        // трассы остальных приборов добавляются по первому свипу
+        QColor traceColor = QColor::fromHsv((num * 40) % 360, 200, 200);
+        _chartManager->addTrace(DeviceManager::chartTraceKey(_devices->primaryDevice(), num), traceName, traceColor);
+    }
 
-        _chartManager->addTrace(num, traceName, traceColor);
-        traceNumbers.append(num);
+    _controller->setTraces(traces, sweepType, powerFreqHz);
 
-        cmds.append(new CALC_PARAMETER_DEFINE(num, type));
+    QVector<int> complexTraces;
+    for (const TraceInfo& info : traces) {
+        if (ComplexTrace::isComplexFormat(info.format)) complexTraces.append(info.num);
+    }
+    _math->setComplexTraces(complexTraces);
+    _math->restartAveraging();
+}
 
-        if (port > 0) {
-            cmds.append(new CALC_PARAMETER_SPORT(num, port));
-        }
+void Widget::setTraceMath(const QVariantMap& params)
+{
+    const QString average = params.value("average").toString();
+    const QString memory = params.value("memory").toString();
+    const QString output = params.value("output").toString();
+    TraceMathSettings settings;
+    settings.average = average == "exp" ? TraceAverage::Exponential
+                       : average == "boxcar" ? TraceAverage::Boxcar : TraceAverage::Off;
+    settings.averageCount = params.value("averageCount", settings.averageCount).toInt();
+    settings.memory = memory == "subtract" ? TraceMemoryMath::Subtract
+                      : memory == "divide" ? TraceMemoryMath::Divide : TraceMemoryMath::Off;
+    settings.output = output == "db" ? TraceOutput::MagnitudeDb
+                      : output == "lin" ? TraceOutput::LinearMagnitude
+                      : output == "phase" ? TraceOutput::PhaseDeg : TraceOutput::AsMeasured;
+    settings.smoothPoints = params.value("smoothPoints", 0).toInt();
+    _mathSettings = settings;
+    _math->setSettings(settings);
+}
 
-        cmds.append(new CALC_TRACE_SELECT(num));
-        cmds.append(new CALC_TRACE_FORMAT(num, scpiUnit));
-        cmds.append(new DISP_WIND_TRACE(1, num));
-    }
+void Widget::storeTraceMemory()
+{
+    _math->storeMemory();
+}
 
-    cmds.append(new OPC_QUERY());
+void Widget::clearTraceMemory()
+{
+    _math->clearMemory();
+}
 
-    if (_vnaClient && !cmds.isEmpty()) {
-        QVector<VNAcomand*> cmdsCopy = cmds;
-        QMetaObject::invokeMethod(_vnaClient, "setGraphSettings", Qt::QueuedConnection,
-                                  Q_ARG(int, graphCount),
-                                  Q_ARG(QVector<int>, traceNumbers));
+void Widget::setFocusTrace(int num)
+{
+    _controller->setFocusTrace(num);
+}
 
-        QHostAddress targetHost;
-        if (!_currentIP.isEmpty() && targetHost.setAddress(_currentIP)) {
-            QMetaObject::invokeMethod(_vnaClient, "sendCommand", Qt::QueuedConnection,
-                                      Q_ARG(QHostAddress, targetHost),
-                                      Q_ARG(quint16, _currentPort),
-                                      Q_ARG(QVector<VNAcomand*>, cmdsCopy));
-        }
-    } else {
-        qDeleteAll(cmds);
-    }
+void Widget::setBackgroundRefresh(int everySweeps)
+{
+    _controller->setBackgroundRefresh(everySweeps);
 }
 
-void Widget::startSocketThread()
+void Widget::setSegmentPoints(int pointsPerSegment)
 {
-    Socket* socket = qobject_cast<Socket*>(_vnaClient);
-    if (socket) {
-        socket->startThread();
-    }
+    _controller->setSegmentPoints(pointsPerSegment);
 }
 
-void Widget::stopSocketThread()
+void Widget::ensureChartTrace(int deviceId, int traceNum)
 {
-    Socket* socket = qobject_cast<Socket*>(_vnaClient);
-    if (socket) {
-        socket->stopThread();
+    const int key = DeviceManager::chartTraceKey(deviceId, traceNum);
+    if (_chartManager->hasTrace(key)) return;
+    QColor traceColor = QColor::fromHsv((traceNum * 40 + deviceId * 97) % 360, 200, 200);
+    QString name = QString("Trace %1").arg(traceNum);
+    if (_devices->deviceIds().size() > 1) {
+        name = QString("%1: %2").arg(_devices->deviceName(deviceId), name);
     }
+    _chartManager->addTrace(key, name, traceColor);
 }
 
-void Widget::dataFromVNA(const QString& data, VNAcomand* cmd)
+void Widget::dataFromVNA(int deviceId, const QByteArray& data, const ScpiCommand& cmd)
 {
-    if (!cmd) return;
-    if (auto* xaxisCmd = dynamic_cast<CALC_TRACE_DATA_XAXIS*>(cmd)) {
-        _frequencyData = xaxisCmd->parseResponse(data);
-    } else if (auto* traceCmd = dynamic_cast<CALC_TRACE_DATA_FDAT*>(cmd)) {
-        QVector<qreal> amplitudeData = traceCmd->parseResponse(data);
+    if (deviceId != _devices->primaryDevice()) return;
+    if (cmd.id == ScpiId::TraceXAxis) {
+        _frequencyData = parseFrequencyKHz(data, cmd.dataFormat, cmd.littleEndian);
+    } else if (cmd.id == ScpiId::TraceData) {
+        const ComplexTrace trace = parseReply<ScpiId::TraceData>(data, cmd.dataFormat, cmd.littleEndian);
+        _traces.insert(cmd.trace, trace);
+        const QVector<qreal>& amplitudeData = trace.real();
         QVector<qreal> xData;
         if (!_frequencyData.isEmpty() && _frequencyData.size() == amplitudeData.size()) {
             xData = _frequencyData;
@@ -238,21 +281,223 @@ void Widget::dataFromVNA(const QString& data, VNAcomand* cmd)
                 xData.append(i);
             }
         }
-        int traceNum = traceCmd->type;
-        if (!_chartManager->hasTrace(traceNum)) {
-            QColor traceColor = QColor::fromHsv((traceNum * 40) % 360, 200, 200);
-            _chartManager->addTrace(traceNum, QString("Trace %1").arg(traceNum), traceColor);
-        }
-        _chartManager->updateTraceData(traceNum, xData, amplitudeData);
+        int traceNum = cmd.trace;
+        ensureChartTrace(deviceId, traceNum);
+        _chartManager->updateTraceData(DeviceManager::chartTraceKey(deviceId, traceNum), xData, amplitudeData);
         _chartManager->autoScaleAxes();
         _chartView->update();
     }
-    delete cmd;
 }
 
-void Widget::errorMessage(int code, const QString& message)
+void Widget::onSweepReady(int deviceId, SweepFramePtr frame)
+{
+    if (!frame) return;
+    // в файл выгружаются данные прибора, без клиентской математики
+    if (deviceId == _devices->primaryDevice()) _lastFrame = frame;
+    // без математики движок возвращает тот же кадр, не копируя
+    _math->submit(deviceId, frame);
+}
+
+void Widget::displaySweep(int deviceId, SweepFramePtr frame)
+{
+    if (!frame) return;
+    if (deviceId == _devices->primaryDevice()) {
+        _traces = frame->traces;
+        _frequencyData = frame->frequencyKHz;
+    }
+    for (auto it = frame->traces.constBegin(); it != frame->traces.constEnd(); ++it) {
+        ensureChartTrace(deviceId, it.key());
+    }
+    _chartManager->updateSweep(*frame, DeviceManager::chartTraceKey(deviceId, 0));
+}
+
+void Widget::onSweepSegment(int deviceId, SweepFramePtr segment, int firstPoint, int totalPoints)
+{
+    // среднее и память считаются по полному свипу — сегменты сырых данных не показываются
+    if (!segment || !_mathSettings.isIdentity()) return;
+    for (auto it = segment->traces.constBegin(); it != segment->traces.constEnd(); ++it) {
+        ensureChartTrace(deviceId, it.key());
+    }
+    _chartManager->updateSweepSegment(*segment, firstPoint, totalPoints, DeviceManager::chartTraceKey(deviceId, 0));
+}
+
+void Widget::errorMessage(int deviceId, int code, const QString& message)
+{
+    QMessageBox::warning(this, "VNA Error", QString("%1 (%2:%3)\nCode: %4\nMessage: %5")
+                         .arg(_devices->deviceName(deviceId), _devices->deviceHost(deviceId))
+                         .arg(_devices->devicePort(deviceId)).arg(code).arg(message));
+}
+
+int Widget::addDevice(const QString& ip, quint16 port)
+{
+    QHostAddress addr;
+    if (!addr.setAddress(ip)) {
+        showIpPortError(QString("Некорректный IP: %1").arg(ip));
+        return -1;
+    }
+    if (port == 0) {
+        showIpPortError(QString("Некорректный порт: %1").arg(port));
+        return -1;
+    }
+    return _devices->addDevice(QString(), ip, port);
+}
+
+void Widget::removeDevice(int deviceId)
+{
+    if (deviceId == _devices->primaryDevice()) return;
+    _devices->removeDevice(deviceId);
+    const QList<int> keys = _chartManager->getTraceNumbers();
+    for (int key : keys) {
+        if (key / DEVICE_TRACE_STRIDE == deviceId) _chartManager->removeTrace(key);
+    }
+}
+
+void Widget::setLockstepSweeps(bool lockstep)
+{
+    _devices->setScheduling(lockstep ? SweepScheduling::Lockstep : SweepScheduling::FreeRunning);
+}
+
+bool Widget::startRecording(const QString& basePath)
+{
+    QString base = basePath;
+    if (base.isEmpty()) {
+        base = QDir::current().filePath(
+            QString("tair-%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    }
+    const bool ok = _devices->startRecording(base);
+    emit recordingChanged();
+    emit devicesChanged();
+    return ok;
+}
+
+void Widget::stopRecording()
+{
+    _devices->stopRecording();
+    emit recordingChanged();
+    emit devicesChanged();
+}
+
+bool Widget::isRecording() const
+{
+    return _devices->isRecording();
+}
+
+QString Widget::startCapture(const QString& path)
+{
+    Socket* socket = qobject_cast<Socket*>(_vnaClient);
+    if (!socket) return QString();
+    QString target = path;
+    if (target.isEmpty()) {
+        target = QDir::current().filePath(
+            QString("tair-session-%1.tcap").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    }
+    return socket->startCapture(target) ? target : QString();
+}
+
+void Widget::stopCapture()
+{
+    if (Socket* socket = qobject_cast<Socket*>(_vnaClient)) socket->stopCapture();
+}
+
+bool Widget::openReplay(const QString& path)
+{
+    if (!_replay) {
+        _replay = new ReplayClient();
+        const auto primary = [this]() { return _devices->primaryDevice(); };
+        connect(_replay, &VNAclient::sweepReady, this, [this, primary]() {
+            if (SweepFramePtr frame = _replay->takeSweep()) onSweepReady(primary(), frame);
+        });
+        connect(_replay, &VNAclient::dataFromVNA, this, [this, primary](const QByteArray& data, const ScpiCommand& cmd) {
+            dataFromVNA(primary(), data, cmd);
+        });
+        connect(_replay, &ReplayClient::positionChanged, this, [this](int sweepIndex) {
+            _replayPosition = sweepIndex;
+            emit replayChanged();
+        });
+        _replay->startThread();
+    }
+    _replay->stopScan();
+    const bool ok = _replay->open(path);
+    _replayPosition = -1;
+    emit replayChanged();
+    if (!ok) {
+        QMessageBox::warning(this, "Replay", _replay->errorString());
+    }
+    return ok;
+}
+
+void Widget::startReplay()
+{
+    if (!_replay) return;
+    // живые свипы и запись рисуются на одних и тех же трассах
+    _devices->stopAll();
+    _replay->startScan(QString(), 0, 0, 0, 0, 0, 0.0, 0);
+}
+
+void Widget::stopReplay()
 {
-    QMessageBox::warning(this, "VNA Error", QString("Code: %1\nMessage: %2").arg(code).arg(message));
+    if (_replay) _replay->stopScan();
+}
+
+void Widget::setReplaySpeed(double speed)
+{
+    if (_replay) _replay->setSpeed(speed);
+}
+
+void Widget::seekReplay(int sweepIndex)
+{
+    if (_replay) _replay->seekToSweep(sweepIndex);
+}
+
+bool Widget::exportSweeps(const QString& format, const QString& basePath, const QString& recordingPath)
+{
+    ExportOptions options;
+    options.format = format.compare(QLatin1String("touchstone"), Qt::CaseInsensitive) == 0 ? ExportFormat::Touchstone
+                                                                                           : ExportFormat::Csv;
+    options.basePath = basePath;
+    if (options.basePath.isEmpty()) {
+        options.basePath = QDir::current().filePath(
+            QString("tair-export-%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    }
+    for (const TraceInfo& trace : _controller->traces()) {
+        options.traceParameters.insert(trace.num, trace.param);
+        options.traceFormats.insert(trace.num, trace.format);
+    }
+
+    if (!recordingPath.isEmpty()) {
+        return _exporter->exportRecording(recordingPath, options);
+    }
+    if (!_lastFrame) {
+        qWarning() << "exportSweeps: no sweep to export yet";
+        return false;
+    }
+    return _exporter->exportFrames({_lastFrame}, options);
+}
+
+void Widget::cancelExport()
+{
+    _exporter->cancel();
+}
+
+int Widget::replaySweepCount() const
+{
+    return _replay ? _replay->sweepCount() : 0;
+}
+
+QVariantList Widget::devices() const
+{
+    QVariantList list;
+    for (int deviceId : _devices->deviceIds()) {
+        QVariantMap device;
+        device.insert("id", deviceId);
+        device.insert("name", _devices->deviceName(deviceId));
+        device.insert("ip", _devices->deviceHost(deviceId));
+        device.insert("port", _devices->devicePort(deviceId));
+        device.insert("primary", deviceId == _devices->primaryDevice());
+        device.insert("recordingPath", _devices->recordingPath(deviceId));
+        list.append(device);
+    }
+    return list;
 }
 
 void Widget::showIpPortError(const QString &msg)
@@ -260,6 +505,46 @@ void Widget::showIpPortError(const QString &msg)
     QMessageBox::warning(this, "IP/Port Error", msg);
 }
 
+void Widget::setDataTransferMode(const QString& format, bool littleEndian)
+{
+    TraceDataFormat dataFormat = TraceDataFormat::Ascii;
+    if (format == "REAL32") {
+        dataFormat = TraceDataFormat::Real32;
+    } else if (format == "REAL" || format == "REAL64") {
+        dataFormat = TraceDataFormat::Real64;
+    }
+    _devices->setDataTransferMode(dataFormat, littleEndian);
+}
+
+void Widget::setVerifyConfiguration(bool verify)
+{
+    _devices->setVerifyConfiguration(verify);
+}
+
+QVariantMap Widget::socketStats() const
+{
+    Socket* socket = qobject_cast<Socket*>(_vnaClient);
+    if (!socket) return QVariantMap();
+    return socket->metrics().snapshot();
+}
+
+QString Widget::dumpSocketStats(const QString& path)
+{
+    Socket* socket = qobject_cast<Socket*>(_vnaClient);
+    if (!socket) return QString();
+    QString target = path;
+    if (target.isEmpty()) {
+        target = QDir::current().filePath(
+            QString("tair-stats-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    }
+    if (!socket->metrics().dumpToFile(target)) {
+        qWarning() << "dumpSocketStats: cannot write" << target;
+        return QString();
+    }
+    qDebug() << "Socket stats written to" << target;
+    return target;
+}
+
 void Widget::updateConnectionSettings(const QString& ip, quint16 port)
 {
     if (port < 1 || port > 65535) {
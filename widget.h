@@ -3,42 +3,109 @@
 
 #include "vnaclient.h"
 #include "createrchart.h"
+#include "devicemanager.h"
+#include "tracemath.h"
 #include <QWidget>
 #include <QChartView>
 #include <QVector>
 #include <QHash>
+#include <QMap>
 #include <QColor>
+#include <QVariantMap>
 
 class VNAclient;
+class ReplayClient;
+class SweepExporter;
+class VnaController;
+class QTimer;
 class CreaterChart;
 
 class Widget : public QWidget
 {
     Q_OBJECT
+    Q_PROPERTY(QVariantMap socketStats READ socketStats NOTIFY socketStatsChanged)
+    Q_PROPERTY(QVariantList devices READ devices NOTIFY devicesChanged)
+    Q_PROPERTY(bool recording READ isRecording NOTIFY recordingChanged)
+    Q_PROPERTY(int replaySweepCount READ replaySweepCount NOTIFY replayChanged)
+    Q_PROPERTY(int replayPosition READ replayPosition NOTIFY replayChanged)
 
 public:
-    explicit Widget(VNAclient* client, QWidget* parent = nullptr);
+    explicit Widget(DeviceManager* devices, QWidget* parent = nullptr);
     ~Widget();
 
     Q_INVOKABLE void startScanFromQml(const QString& ip, quint16 port, int startKHz, int stopKHz, int points, int band, double powerDbM, int powerFreqKHz);
     Q_INVOKABLE void stopScanFromQml(const QString& ip, int port);
     Q_INVOKABLE void applyGraphSettings(const QVariantList& graphs, const QVariantMap& params);
+    // num — трасса, читаемая каждый свип (0 — все); остальные раз в everySweeps свипов
+    Q_INVOKABLE void setFocusTrace(int num);
+    Q_INVOKABLE void setBackgroundRefresh(int everySweeps);
+    // Точек в сегменте широкого свипа; график обновляется по мере прихода сегментов
+    Q_INVOKABLE void setSegmentPoints(int pointsPerSegment);
+    // Математика трасс: average ("off"/"exp"/"boxcar"), averageCount,
+    // memory ("off"/"subtract"/"divide"), output ("raw"/"db"/"lin"/"phase"), smoothPoints
+    Q_INVOKABLE void setTraceMath(const QVariantMap& params);
+    Q_INVOKABLE void storeTraceMemory();
+    Q_INVOKABLE void clearTraceMemory();
     Q_INVOKABLE void updateConnectionSettings(const QString& ip, quint16 port);
+    Q_INVOKABLE void setDataTransferMode(const QString& format, bool littleEndian);
+    // Читать настройки обратно после каждой перенастройки прибора
+    Q_INVOKABLE void setVerifyConfiguration(bool verify);
+    Q_INVOKABLE QString dumpSocketStats(const QString& path = QString());
+    Q_INVOKABLE int addDevice(const QString& ip, quint16 port);
+    Q_INVOKABLE void removeDevice(int deviceId);
+    Q_INVOKABLE void setLockstepSweeps(bool lockstep);
+    Q_INVOKABLE bool startRecording(const QString& basePath = QString());
+    Q_INVOKABLE void stopRecording();
+    Q_INVOKABLE QString startCapture(const QString& path = QString());
+    Q_INVOKABLE void stopCapture();
+    Q_INVOKABLE bool openReplay(const QString& path);
+    Q_INVOKABLE void startReplay();
+    Q_INVOKABLE void stopReplay();
+    Q_INVOKABLE void setReplaySpeed(double speed);
+    Q_INVOKABLE void seekReplay(int sweepIndex);
+    // format: "touchstone" или "csv"; без recordingPath выгружается текущий свип
+    Q_INVOKABLE bool exportSweeps(const QString& format, const QString& basePath = QString(),
+                                  const QString& recordingPath = QString());
+    Q_INVOKABLE void cancelExport();
+
+    QVariantMap socketStats() const;
+    QVariantList devices() const;
+    bool isRecording() const;
+    int replaySweepCount() const;
+    int replayPosition() const { return _replayPosition; }
+
+signals:
+    void socketStatsChanged();
+    void devicesChanged();
+    void recordingChanged();
+    void replayChanged();
+    void exportProgress(int done, int total);
+    void exportFinished(bool ok, const QStringList& files, const QString& error);
 
 private slots:
-    void dataFromVNA(const QString& data, VNAcomand* cmd);
-    void errorMessage(int code, const QString& message);
+    void dataFromVNA(int deviceId, const QByteArray& data, const ScpiCommand& cmd);
+    void onSweepReady(int deviceId, SweepFramePtr frame);
+    void onSweepSegment(int deviceId, SweepFramePtr segment, int firstPoint, int totalPoints);
+    void displaySweep(int deviceId, SweepFramePtr frame);
+    void errorMessage(int deviceId, int code, const QString& message);
 
 private:
     void setupUi();
-    void startSocketThread();
-    void stopSocketThread();
     void setOptimalScanSettings();
+    void ensureChartTrace(int deviceId, int traceNum);
     void showIpPortError(const QString &msg);
 
-    VNAclient* _vnaClient;
+    DeviceManager* _devices;
+    VNAclient* _vnaClient;      // первый прибор: его адрес задаётся в основной форме
     CreaterChart* _chartManager;
     QChartView* _chartView;
+    QTimer* _statsTimer;
+    ReplayClient* _replay;      // воспроизведение записи сеанса, показывается как первый прибор
+    int _replayPosition;
+    SweepExporter* _exporter;
+    VnaController* _controller;  // конфигурация трасс и план их опроса
+    TraceMathEngine* _math;      // свипы идут на график через него, в своём потоке
+    TraceMathSettings _mathSettings;
 
     QString _currentIP;
     quint16 _currentPort;
@@ -50,6 +117,8 @@ private:
     int _currentPowerFreqKHz;
 
     QVector<qreal> _frequencyData;
+    QMap<int, ComplexTrace> _traces;
+    SweepFramePtr _lastFrame;       // последний свип прибора до математики — для выгрузки
 };
 
 #endif // WIDGET_H
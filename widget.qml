@@ -19,7 +19,7 @@ Rectangle {
     // Единицы измерений
     property var measurementUnits: [
         "Амп.лог", "КСВН", "Фаза", "Фаза>180", "ГВЗ",
-        "Амп лин", "Реал", "Мним"
+        "Амп лин", "Реал", "Мним", "Полярн"
     ]
 
     function getPortFromType(type) {
@@ -581,8 +581,8 @@ Rectangle {
             } else {
                 running = false
                 isRunning = false
-                if (vnaClient) {
-                    vnaClient.stopScan()
+                if (mainWidget) {
+                    mainWidget.stopScanFromQml(numberOf_IP_Input.text, parseInt(numberOfPortInput.text))
                 }
             }
         }
@@ -877,6 +877,428 @@ Rectangle {
                    notifyC()
            }
     }
+    // Дополнительные приборы: первый задаётся полями IP/порт основной формы
+    Text {
+        id: devicesToggle
+        text: (devicesPopup.visible ? "Приборы ▴" : "Приборы ▾") + " (" + (mainWidget ? mainWidget.devices.length : 1) + ")"
+        color: "#888888"
+        font.pixelSize: 11
+        anchors.left: parent.left
+        anchors.top: parent.top
+        anchors.leftMargin: 8
+        anchors.topMargin: 10
+        MouseArea {
+            anchors.fill: parent
+            onClicked: devicesPopup.visible ? devicesPopup.close() : devicesPopup.open()
+        }
+    }
+
+    Popup {
+        id: devicesPopup
+        x: 8
+        y: devicesToggle.y + devicesToggle.height + 4
+        width: root.width - 16
+        padding: 8
+        closePolicy: Popup.CloseOnEscape
+        background: Rectangle {
+            radius: 6
+            color: "#202020"
+            border.color: "#555"
+        }
+        ColumnLayout {
+            width: parent.width
+            spacing: 6
+            Repeater {
+                model: mainWidget ? mainWidget.devices : []
+                RowLayout {
+                    Layout.fillWidth: true
+                    Text {
+                        Layout.fillWidth: true
+                        text: modelData.name + "  " + modelData.ip + ":" + modelData.port
+                              + (modelData.recordingPath ? "  ● " + modelData.recordingPath : "")
+                        color: "#e0e0e0"
+                        font.family: "Consolas"
+                        font.pixelSize: 12
+                    }
+                    Button {
+                        text: "✕"
+                        visible: !modelData.primary
+                        implicitWidth: 28
+                        onClicked: mainWidget.removeDevice(modelData.id)
+                    }
+                }
+            }
+            RowLayout {
+                Layout.fillWidth: true
+                TextField {
+                    id: newDeviceIp
+                    Layout.fillWidth: true
+                    placeholderText: "IP"
+                }
+                TextField {
+                    id: newDevicePort
+                    implicitWidth: 70
+                    placeholderText: "5025"
+                    validator: IntValidator { bottom: 1; top: 65535 }
+                }
+                Button {
+                    text: "Добавить"
+                    onClicked: {
+                        if (!mainWidget || newDeviceIp.text === "") return
+                        let port = newDevicePort.text === "" ? 5025 : parseInt(newDevicePort.text)
+                        if (mainWidget.addDevice(newDeviceIp.text, port) >= 0) {
+                            newDeviceIp.text = ""
+                            newDevicePort.text = ""
+                        }
+                    }
+                }
+            }
+            CheckBox {
+                text: "Проверять настройки прибора"
+                onToggled: if (mainWidget) mainWidget.setVerifyConfiguration(checked)
+            }
+            CheckBox {
+                text: "Синхронные свипы"
+                onToggled: if (mainWidget) mainWidget.setLockstepSweeps(checked)
+            }
+            // Опрос трасс: выбранная читается каждый свип, остальные — реже
+            RowLayout {
+                Layout.fillWidth: true
+                Text {
+                    text: "Каждый свип:"
+                    color: "#e0e0e0"
+                }
+                ComboBox {
+                    id: focusTraceCombo
+                    Layout.fillWidth: true
+                    model: {
+                        let items = ["Все трассы"]
+                        for (let i = 0; i < graphModel.count; ++i)
+                            items.push("Трасса " + graphModel.get(i).num)
+                        return items
+                    }
+                    onActivated: if (mainWidget) mainWidget.setFocusTrace(currentIndex > 0 ? graphModel.get(currentIndex - 1).num : 0)
+                    // набор трасс изменился — номера могли сдвинуться
+                    onModelChanged: {
+                        currentIndex = 0
+                        if (mainWidget) mainWidget.setFocusTrace(0)
+                    }
+                }
+                Text {
+                    text: "остальные раз в"
+                    color: "#e0e0e0"
+                    enabled: focusTraceCombo.currentIndex > 0
+                }
+                SpinBox {
+                    from: 1
+                    to: 100
+                    value: 4
+                    enabled: focusTraceCombo.currentIndex > 0
+                    Component.onCompleted: if (mainWidget) mainWidget.setBackgroundRefresh(value)
+                    onValueModified: if (mainWidget) mainWidget.setBackgroundRefresh(value)
+                }
+            }
+            // Широкий линейный свип снимается частями, график дорисовывается по сегментам
+            RowLayout {
+                CheckBox {
+                    id: segmentedSweep
+                    text: "Сегменты по"
+                    onToggled: if (mainWidget) mainWidget.setSegmentPoints(checked ? segmentPointsBox.value : 0)
+                }
+                SpinBox {
+                    id: segmentPointsBox
+                    from: 101
+                    to: 100001
+                    stepSize: 1000
+                    value: 10001
+                    editable: true
+                    enabled: segmentedSweep.checked
+                    onValueModified: if (mainWidget) mainWidget.setSegmentPoints(value)
+                }
+                Text {
+                    text: "точек"
+                    color: "#e0e0e0"
+                }
+            }
+            // Математика трасс в клиенте: усреднение, память, формат, сглаживание
+            GridLayout {
+                id: traceMath
+                columns: 3
+                Layout.fillWidth: true
+
+                function apply() {
+                    if (!mainWidget) return
+                    mainWidget.setTraceMath({
+                        "average": ["off", "exp", "boxcar"][averageCombo.currentIndex],
+                        "averageCount": averageCountBox.value,
+                        "memory": ["off", "subtract", "divide"][memoryCombo.currentIndex],
+                        "output": ["raw", "db", "lin", "phase"][outputCombo.currentIndex],
+                        "smoothPoints": smoothCheck.checked ? smoothPointsBox.value : 0
+                    })
+                }
+
+                Text {
+                    text: "Усреднение:"
+                    color: "#e0e0e0"
+                }
+                ComboBox {
+                    id: averageCombo
+                    Layout.fillWidth: true
+                    model: ["Выкл", "Экспоненциальное", "Скользящее"]
+                    onActivated: traceMath.apply()
+                }
+                SpinBox {
+                    id: averageCountBox
+                    from: 2
+                    to: 999
+                    value: 16
+                    editable: true
+                    enabled: averageCombo.currentIndex > 0
+                    onValueModified: traceMath.apply()
+                }
+
+                Text {
+                    text: "Память:"
+                    color: "#e0e0e0"
+                }
+                ComboBox {
+                    id: memoryCombo
+                    Layout.fillWidth: true
+                    model: ["Выкл", "Данные − Память", "Данные / Память"]
+                    onActivated: traceMath.apply()
+                }
+                RowLayout {
+                    Button {
+                        text: "В память"
+                        onClicked: if (mainWidget) mainWidget.storeTraceMemory()
+                    }
+                    Button {
+                        text: "Сброс"
+                        onClicked: if (mainWidget) mainWidget.clearTraceMemory()
+                    }
+                }
+
+                Text {
+                    text: "Формат:"
+                    color: "#e0e0e0"
+                }
+                ComboBox {
+                    id: outputCombo
+                    Layout.fillWidth: true
+                    // только для трасс в комплексном формате (Полярн)
+                    model: ["Как измерено", "Амп.лог", "Амп лин", "Фаза"]
+                    onActivated: traceMath.apply()
+                }
+                Item { width: 1 }
+
+                CheckBox {
+                    id: smoothCheck
+                    text: "Сглаживание"
+                    onToggled: traceMath.apply()
+                }
+                SpinBox {
+                    id: smoothPointsBox
+                    from: 3
+                    to: 10001
+                    stepSize: 2
+                    value: 11
+                    editable: true
+                    enabled: smoothCheck.checked
+                    onValueModified: traceMath.apply()
+                }
+                Text {
+                    text: "точек"
+                    color: "#e0e0e0"
+                }
+            }
+            CheckBox {
+                text: "Записывать свипы"
+                checked: mainWidget ? mainWidget.recording : false
+                onToggled: {
+                    if (!mainWidget) return
+                    if (checked) mainWidget.startRecording()
+                    else mainWidget.stopRecording()
+                }
+            }
+            CheckBox {
+                text: "Записывать обмен SCPI (для повтора)"
+                onToggled: {
+                    if (!mainWidget) return
+                    if (checked) checked = mainWidget.startCapture() !== ""
+                    else mainWidget.stopCapture()
+                }
+            }
+            // Повтор записанного сеанса через тот же разбор и график
+            RowLayout {
+                Layout.fillWidth: true
+                TextField {
+                    id: replayPath
+                    Layout.fillWidth: true
+                    placeholderText: "Файл .tcap"
+                }
+                Button {
+                    text: "Открыть"
+                    onClicked: if (mainWidget && replayPath.text !== "") mainWidget.openReplay(replayPath.text)
+                }
+            }
+            RowLayout {
+                Layout.fillWidth: true
+                enabled: mainWidget ? mainWidget.replaySweepCount > 0 : false
+                ComboBox {
+                    id: replaySpeed
+                    implicitWidth: 80
+                    model: ["1×", "4×", "16×", "Макс"]
+                    property var speeds: [1, 4, 16, 0]
+                    onActivated: mainWidget.setReplaySpeed(speeds[currentIndex])
+                }
+                Button {
+                    text: "▶"
+                    implicitWidth: 36
+                    onClicked: mainWidget.startReplay()
+                }
+                Button {
+                    text: "■"
+                    implicitWidth: 36
+                    onClicked: mainWidget.stopReplay()
+                }
+                Slider {
+                    Layout.fillWidth: true
+                    from: 0
+                    to: mainWidget ? Math.max(0, mainWidget.replaySweepCount - 1) : 0
+                    stepSize: 1
+                    value: mainWidget ? Math.max(0, mainWidget.replayPosition) : 0
+                    onMoved: mainWidget.seekReplay(Math.round(value))
+                }
+                Text {
+                    text: mainWidget ? (mainWidget.replayPosition + 1) + "/" + mainWidget.replaySweepCount : ""
+                    color: "#e0e0e0"
+                    font.family: "Consolas"
+                    font.pixelSize: 12
+                }
+            }
+            // Выгрузка текущего свипа или файла записи .tsweep
+            RowLayout {
+                Layout.fillWidth: true
+                ComboBox {
+                    id: exportFormat
+                    implicitWidth: 120
+                    model: ["CSV", "Touchstone"]
+                }
+                TextField {
+                    id: exportSource
+                    Layout.fillWidth: true
+                    placeholderText: "Файл .tsweep (пусто — текущий свип)"
+                }
+                Button {
+                    text: "Экспорт"
+                    onClicked: {
+                        if (!mainWidget) return
+                        exportStatus.text = mainWidget.exportSweeps(exportFormat.currentText.toLowerCase(), "", exportSource.text)
+                                ? "…" : "Нечего выгружать"
+                    }
+                }
+                Text {
+                    id: exportStatus
+                    color: "#e0e0e0"
+                    font.family: "Consolas"
+                    font.pixelSize: 12
+                }
+            }
+            Connections {
+                target: mainWidget
+                function onExportProgress(done, total) { exportStatus.text = done + "/" + total }
+                function onExportFinished(ok, files, error) {
+                    exportStatus.text = ok ? "Готово: " + files.length + " файл(ов)" : error
+                }
+            }
+        }
+    }
+
+    // Статистика потока сокета (обновляется раз в секунду из Widget)
+    function formatMicros(us) {
+        if (us >= 1000000) return (us / 1000000).toFixed(2) + " с"
+        if (us >= 1000) return (us / 1000).toFixed(1) + " мс"
+        return us + " мкс"
+    }
+    function formatTiming(name, t) {
+        if (!t || !t.count) return name + ": —"
+        return name + ": p50 " + formatMicros(t.p50Us) + ", p99 " + formatMicros(t.p99Us)
+                + ", max " + formatMicros(t.maxUs) + " (" + t.count + ")"
+    }
+    function formatStats(s) {
+        if (!s || s.sweepsCompleted === undefined) return "Нет данных"
+        let lines = [
+            "Свипов: " + s.sweepsCompleted + ", пропущено (занят): " + s.sweepsSkippedBusy,
+            "Принято: " + (s.bytesReceived / 1048576).toFixed(2) + " МБ в " + s.repliesReceived + " ответах",
+            "Отправлено команд: " + s.commandsSent,
+            "Таймауты: " + s.replyTimeouts + ", пересинхронизаций: " + s.resyncs + ", отброшено ответов: " + s.staleReplies
+                + ", переподключения: " + s.reconnects,
+            "Попыток переподключения: " + s.reconnectAttempts + ", прибор не ответил на проверку: " + s.healthChecksFailed,
+            "Пропущено чтений трасс по плану опроса: " + s.traceFetchesSkipped,
+            "Настроек без изменений (не отправлены): " + s.settingsSkipped + ", расхождений при проверке: " + s.settingMismatches,
+            "Свипов не показано (GUI занят): " + s.displaySweepsDropped + ", ожиданий записи: " + s.recorderStalls,
+            formatTiming("Свип", s.sweepTime),
+            formatTiming("*OPC?", s.opcWait),
+            formatTiming("Разбор", s.parseTime),
+            formatTiming("Первый сегмент", s.firstSegmentTime)
+        ]
+        for (let i = 0; i < s.commands.length; ++i) {
+            let c = s.commands[i]
+            lines.push(formatTiming(c.header, c))
+        }
+        return lines.join("\n")
+    }
+
+    Text {
+        id: statsToggle
+        text: statsPopup.visible ? "Статистика ▴" : "Статистика ▾"
+        color: "#888888"
+        font.pixelSize: 11
+        anchors.right: parent.right
+        anchors.top: parent.top
+        anchors.rightMargin: 8
+        anchors.topMargin: 10
+        MouseArea {
+            anchors.fill: parent
+            onClicked: statsPopup.visible ? statsPopup.close() : statsPopup.open()
+        }
+    }
+
+    Popup {
+        id: statsPopup
+        x: 8
+        y: statsToggle.y + statsToggle.height + 4
+        width: root.width - 16
+        padding: 8
+        closePolicy: Popup.CloseOnEscape
+        background: Rectangle {
+            radius: 6
+            color: "#202020"
+            border.color: "#555"
+        }
+        ColumnLayout {
+            width: parent.width
+            spacing: 6
+            Text {
+                Layout.fillWidth: true
+                text: statsPopup.visible && mainWidget ? formatStats(mainWidget.socketStats) : ""
+                color: "#e0e0e0"
+                font.family: "Consolas"
+                font.pixelSize: 11
+                wrapMode: Text.WrapAnywhere
+            }
+            Button {
+                text: "Сохранить в файл"
+                Layout.alignment: Qt.AlignRight
+                onClicked: {
+                    if (!mainWidget) return
+                    let path = mainWidget.dumpSocketStats("")
+                    console.log(path !== "" ? "Статистика сохранена: " + path : "Не удалось сохранить статистику")
+                }
+            }
+        }
+    }
+
     // Функция уведомления C++
     function notifyC() {
         Qt.callLater(function() {